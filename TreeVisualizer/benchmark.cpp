@@ -0,0 +1,382 @@
+// Headless benchmark of the tree engines. Every engine runs the same phases
+// (insert all keys, find them all one by one and then with FindBatch, erase
+// them all, or a replayed operation list) and each phase is reported with
+// its wall time and hardware counters per operation, as CSV or JSON.
+//
+//   TreeBenchmark [--keys N] [--order random|sequential] [--seed S]
+//                 [--engines avl,rb,splay,treap,scapegoat,veb,art,btree:64,paged:F]
+//                 [--replay FILE]
+//                 [--format csv|json] [--pool-pages N] [--page-file PATH]
+//
+// The paged engine keeps its pages in PATH behind a buffer pool of N pages;
+// it also runs the finds cold, with the pool emptied and the file read past
+// the OS cache, and reports the page reads and writes of every phase on
+// stderr. Give it more keys than the pool holds to measure it out of core.
+// An I/O error stops the run with a nonzero exit status.
+//
+// A replay file holds one operation per line: "insert 5", "erase 5" or
+// "find 5". The engine btree:auto first calibrates the factor on the keys
+// inserted and the mix of the operations (see FactorTuner.h) and reports the
+// timings on stderr.
+
+#include "impl/AVLTree.cpp"
+#include "impl/RBTree.cpp"
+#include "impl/SplayTree.cpp"
+#include "impl/BTree.cpp"
+#include "impl/Treap.cpp"
+#include "impl/ScapegoatTree.cpp"
+#include "impl/VebTree.cpp"
+#include "impl/ArtTree.cpp"
+#include "impl/PagedBTree.cpp"
+#include "impl/TreeEngine.cpp"
+#include "impl/OperationTrace.cpp"
+#include "impl/KeyPermutation.cpp"
+#include "impl/PerfCounters.cpp"
+#include "impl/FactorTuner.cpp"
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <span>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct Operation {
+  enum Kind : uint8_t {
+    kInsert,
+    kErase,
+    kFind
+  };
+
+  Kind kind;
+  int key;
+};
+
+struct Phase {
+  std::string name;
+  std::vector<Operation> operations;
+  // Finds submitted together through FindBatch.
+  bool batched = false;
+  // Run only by engines with a buffer pool, after dropping its caches.
+  bool cold = false;
+};
+
+struct Result {
+  std::string engine, phase;
+  size_t operations = 0, hits = 0;
+  double seconds = 0;
+  TreeStats stats;
+  int64_t counters[PerfCounters::kCounterCount];
+};
+
+// False if the buffer pool of the engine failed; the phase it failed in is
+// not reported.
+template <TreeEngine Engine>
+bool RunPhases(Engine &tree, const std::string &engine, const std::vector<Phase> &phases,
+               PerfCounters &counters, std::vector<Result> &results) {
+  for (const Phase &phase : phases) {
+    if constexpr (requires { tree.GetPool(); }) {
+      // Every read of a cold phase goes to the disk, not only the first ones
+      // after the OS cache was dropped.
+      if (phase.cold) {
+        tree.GetPool().DropCaches();
+        if (!tree.GetPool().SetDirect(true)) {
+          std::cerr << engine << ' ' << phase.name << ": no direct I/O, the OS cache is only dropped at the start\n";
+        }
+      }
+      tree.GetPool().ResetStats();
+    } else if (phase.cold) {
+      continue;
+    }
+    Result result;
+    result.engine = engine;
+    result.phase = phase.name;
+    result.operations = phase.operations.size();
+    std::vector<int> keys;
+    std::vector<uint8_t> found;
+    if (phase.batched) {
+      for (const Operation &operation : phase.operations) {
+        keys.push_back(operation.key);
+      }
+      found.resize(keys.size());
+    }
+    counters.Start();
+    auto start = std::chrono::steady_clock::now();
+    if (phase.batched) {
+      result.hits = tree.FindBatch(keys, found);
+    }
+    for (const Operation &operation : phase.batched ? std::span<const Operation>() : phase.operations) {
+      if (operation.kind == Operation::kInsert) {
+        tree.Insert(operation.key);
+      } else if (operation.kind == Operation::kErase) {
+        tree.Erase(operation.key);
+      } else {
+        result.hits += tree.Find(operation.key);
+      }
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    counters.Stop();
+    for (int i = 0; i < PerfCounters::kCounterCount; i++) {
+      result.counters[i] = counters.Value(PerfCounters::Counter(i));
+    }
+    if constexpr (requires { tree.GetPool(); }) {
+      if (phase.cold) {
+        tree.GetPool().SetDirect(false);
+      }
+      if (tree.GetPool().Failed()) {
+        std::cerr << engine << ' ' << phase.name << ": I/O failed\n";
+        return false;
+      }
+      const BufferPool::Stats &pool = tree.GetPool().GetStats();
+      std::cerr << engine << ' ' << phase.name << ": " << pool.reads << " page reads, " << pool.writes
+                << " page writes\n";
+    }
+    result.stats = tree.GetStats();
+    results.push_back(result);
+  }
+  return true;
+}
+
+bool RunEngine(const std::string &engine, const std::vector<Phase> &phases, PerfCounters &counters,
+               std::vector<Result> &results, const std::string &page_file, size_t pool_pages) {
+  if (engine == "avl") {
+    AVLTree<int> tree;
+    RunPhases(tree, engine, phases, counters, results);
+  } else if (engine == "rb") {
+    RBTree<int> tree;
+    RunPhases(tree, engine, phases, counters, results);
+  } else if (engine == "splay") {
+    SplayTree<int> tree;
+    RunPhases(tree, engine, phases, counters, results);
+  } else if (engine == "treap") {
+    Treap<int> tree;
+    RunPhases(tree, engine, phases, counters, results);
+  } else if (engine == "scapegoat") {
+    ScapegoatTree<int> tree;
+    RunPhases(tree, engine, phases, counters, results);
+  } else if (engine == "veb") {
+    VebTree<int> tree;
+    RunPhases(tree, engine, phases, counters, results);
+  } else if (engine == "art") {
+    ArtTree<int> tree;
+    RunPhases(tree, engine, phases, counters, results);
+  } else if (engine == "paged" || engine.rfind("paged:", 0) == 0) {
+    int factor = engine.size() > 6 ? std::atoi(engine.c_str() + 6) : 0;
+    if (engine.size() > 6 && factor < 2) {
+      return false;
+    }
+    PagedBTree<int> tree(page_file, factor, pool_pages);
+    if (!tree.GetPool().IsOpen() || tree.GetPool().Failed()) {
+      std::cerr << "cannot set up page file " << page_file << '\n';
+      return false;
+    }
+    return RunPhases(tree, "paged:" + std::to_string(tree.factor), phases, counters, results);
+  } else if (engine == "btree:auto") {
+    std::vector<int> keys;
+    size_t finds = 0, updates = 0;
+    for (const Phase &phase : phases) {
+      for (const Operation &operation : phase.operations) {
+        if (operation.kind == Operation::kInsert) {
+          keys.push_back(operation.key);
+        }
+        finds += operation.kind == Operation::kFind;
+        updates += operation.kind != Operation::kFind;
+      }
+    }
+    FactorTuner tuner;
+    tuner.find_share = double(finds) / std::max<size_t>(finds + updates, 1);
+    int factor = tuner.Tune(keys);
+    for (const FactorTuner::Timing &timing : tuner.Timings()) {
+      std::cerr << "btree:auto factor " << timing.factor << ": " << timing.ns_per_op << " ns/op\n";
+    }
+    if (factor == 0) {
+      return false;
+    }
+    BTree<int> tree(factor);
+    RunPhases(tree, "btree:" + std::to_string(factor), phases, counters, results);
+  } else if (engine == "btree" || engine.rfind("btree:", 0) == 0) {
+    int factor = engine.size() > 6 ? std::atoi(engine.c_str() + 6) : 2;
+    if (factor < 2) {
+      return false;
+    }
+    BTree<int> tree(factor);
+    RunPhases(tree, engine, phases, counters, results);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool ReadReplay(const std::string &path, Phase &phase) {
+  std::ifstream in(path);
+  if (!in) {
+    return false;
+  }
+  phase.name = "replay";
+  std::string kind;
+  long long key;
+  while (in >> kind >> key) {
+    if (kind == "insert") {
+      phase.operations.push_back({Operation::kInsert, int(key)});
+    } else if (kind == "erase") {
+      phase.operations.push_back({Operation::kErase, int(key)});
+    } else if (kind == "find") {
+      phase.operations.push_back({Operation::kFind, int(key)});
+    } else {
+      return false;
+    }
+  }
+  return in.eof();
+}
+
+void WriteCsv(const std::vector<Result> &results) {
+  std::cout << "engine,phase,operations,hits,height,bytes,ns_per_op";
+  for (int i = 0; i < PerfCounters::kCounterCount; i++) {
+    std::cout << ',' << PerfCounters::Name(PerfCounters::Counter(i)) << "_per_op";
+  }
+  std::cout << '\n';
+  for (const Result &result : results) {
+    std::cout << result.engine << ',' << result.phase << ',' << result.operations << ',' << result.hits << ','
+              << result.stats.height << ',' << result.stats.bytes << ','
+              << result.seconds * 1e9 / std::max<size_t>(result.operations, 1);
+    for (int64_t value : result.counters) {
+      std::cout << ',';
+      if (value >= 0) {
+        std::cout << double(value) / std::max<size_t>(result.operations, 1);
+      }
+    }
+    std::cout << '\n';
+  }
+}
+
+void WriteJson(const std::vector<Result> &results) {
+  std::cout << "[\n";
+  for (size_t r = 0; r < results.size(); r++) {
+    const Result &result = results[r];
+    std::cout << "  {\"engine\": \"" << result.engine << "\", \"phase\": \"" << result.phase
+              << "\", \"operations\": " << result.operations << ", \"hits\": " << result.hits
+              << ", \"height\": " << result.stats.height << ", \"bytes\": " << result.stats.bytes
+              << ", \"ns_per_op\": " << result.seconds * 1e9 / std::max<size_t>(result.operations, 1);
+    for (int i = 0; i < PerfCounters::kCounterCount; i++) {
+      std::cout << ", \"" << PerfCounters::Name(PerfCounters::Counter(i)) << "_per_op\": ";
+      if (result.counters[i] >= 0) {
+        std::cout << double(result.counters[i]) / std::max<size_t>(result.operations, 1);
+      } else {
+        std::cout << "null";
+      }
+    }
+    std::cout << "}" << (r + 1 < results.size() ? "," : "") << '\n';
+  }
+  std::cout << "]\n";
+}
+
+int Usage() {
+  std::cerr << "usage: TreeBenchmark [--keys N] [--order random|sequential] [--seed S]\n"
+               "                     [--engines avl,rb,splay,treap,scapegoat,veb,art,btree:F,btree:auto,paged:F]\n"
+               "                     [--replay FILE]\n"
+               "                     [--format csv|json] [--pool-pages N] [--page-file PATH]\n";
+  return 1;
+}
+
+int main(int argc, char *argv[]) {
+  int key_count = 1000000;
+  std::string order = "random", engines = "avl,rb,splay,treap,scapegoat,veb,art,btree:2,btree:16,btree:64", replay, format = "csv";
+  uint64_t seed = 1;
+  long long pool_pages = 1024;
+  std::error_code error;
+  std::string page_file = (std::filesystem::temp_directory_path(error) / "TreeBenchmark.pages").string();
+  for (int i = 1; i < argc; i++) {
+    std::string option = argv[i];
+    if (i + 1 == argc) {
+      return Usage();
+    }
+    std::string value = argv[++i];
+    if (option == "--keys") {
+      key_count = std::atoi(value.c_str());
+    } else if (option == "--order") {
+      order = value;
+    } else if (option == "--seed") {
+      seed = std::strtoull(value.c_str(), nullptr, 10);
+    } else if (option == "--engines") {
+      engines = value;
+    } else if (option == "--replay") {
+      replay = value;
+    } else if (option == "--format") {
+      format = value;
+    } else if (option == "--pool-pages") {
+      pool_pages = std::atoll(value.c_str());
+    } else if (option == "--page-file") {
+      page_file = value;
+    } else {
+      return Usage();
+    }
+  }
+  if (key_count <= 0 || uint32_t(key_count) > KeyPermutation::kRange ||
+      (order != "random" && order != "sequential") || (format != "csv" && format != "json") || pool_pages <= 0) {
+    return Usage();
+  }
+
+  // The keys are generated up front, outside of the measured phases.
+  std::vector<Phase> phases;
+  if (!replay.empty()) {
+    phases.emplace_back();
+    if (!ReadReplay(replay, phases.back())) {
+      std::cerr << "cannot read replay file " << replay << '\n';
+      return 1;
+    }
+  } else {
+    KeyPermutation keys(seed), lookups(seed + 1);
+    phases.resize(5);
+    phases[0].name = "insert";
+    phases[1].name = "find";
+    phases[2].name = "find_cold";
+    phases[2].cold = true;
+    phases[3].name = "find_batch";
+    phases[3].batched = true;
+    phases[4].name = "erase";
+    for (int i = 0; i < key_count; i++) {
+      int key = order == "random" ? keys(i) : i + 1;
+      phases[0].operations.push_back({Operation::kInsert, key});
+    }
+    // Finds and erases visit the keys in an order of their own.
+    std::vector<int> shuffled(key_count);
+    for (int i = 0; i < key_count; i++) {
+      shuffled[i] = phases[0].operations[i].key;
+    }
+    if (order == "random") {
+      for (int i = key_count - 1; i > 0; i--) {
+        std::swap(shuffled[i], shuffled[lookups(i) % (i + 1)]);
+      }
+    }
+    for (int key : shuffled) {
+      phases[1].operations.push_back({Operation::kFind, key});
+      phases[2].operations.push_back({Operation::kFind, key});
+      phases[3].operations.push_back({Operation::kFind, key});
+      phases[4].operations.push_back({Operation::kErase, key});
+    }
+  }
+
+  PerfCounters counters;
+  for (int i = 0; i < PerfCounters::kCounterCount; i++) {
+    if (!counters.Available(PerfCounters::Counter(i))) {
+      std::cerr << "counter " << PerfCounters::Name(PerfCounters::Counter(i)) << " is unavailable\n";
+    }
+  }
+  std::vector<Result> results;
+  std::stringstream list(engines);
+  std::string engine;
+  while (std::getline(list, engine, ',')) {
+    if (!RunEngine(engine, phases, counters, results, page_file, pool_pages)) {
+      std::cerr << "cannot run engine " << engine << '\n';
+      return 1;
+    }
+  }
+  if (format == "csv") {
+    WriteCsv(results);
+  } else {
+    WriteJson(results);
+  }
+  return 0;
+}
@@ -0,0 +1,127 @@
+// Headless export of a tree drawing to SVG, free of Qt, e.g. for pictures of
+// large trees from nightly jobs. The tree is filled with generated keys and
+// drawn as in the GUI.
+//
+//   TreeExport [--keys N] [--order random|sequential] [--seed S]
+//              [--engine avl|rb|splay|treap|scapegoat|veb|art|btree:F]
+//              [--tile SIZE] --out PATH
+//
+// Without --tile the drawing goes to PATH as one document; with it, to
+// tiles PATH_ROW_COLUMN.svg of SIZE pixels, empty ones left out.
+
+#include "impl/AVLTree.cpp"
+#include "impl/RBTree.cpp"
+#include "impl/SplayTree.cpp"
+#include "impl/BTree.cpp"
+#include "impl/Treap.cpp"
+#include "impl/ScapegoatTree.cpp"
+#include "impl/VebTree.cpp"
+#include "impl/ArtTree.cpp"
+#include "impl/TreeEngine.cpp"
+#include "impl/KeyPermutation.cpp"
+#include "impl/TreeLayout.cpp"
+#include "impl/SpatialGrid.cpp"
+#include "impl/SvgExport.cpp"
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+
+std::unique_ptr<VisualizableTree<int>> MakeTree(const std::string &engine) {
+  if (engine == "avl") {
+    return std::make_unique<TreeAdapter<AVLTree<int>>>();
+  } else if (engine == "rb") {
+    return std::make_unique<TreeAdapter<RBTree<int>>>();
+  } else if (engine == "splay") {
+    return std::make_unique<TreeAdapter<SplayTree<int>>>();
+  } else if (engine == "treap") {
+    return std::make_unique<TreeAdapter<Treap<int>>>();
+  } else if (engine == "scapegoat") {
+    return std::make_unique<TreeAdapter<ScapegoatTree<int>>>();
+  } else if (engine == "veb") {
+    return std::make_unique<TreeAdapter<VebTree<int>>>();
+  } else if (engine == "art") {
+    return std::make_unique<TreeAdapter<ArtTree<int>>>();
+  } else if (engine == "btree" || engine.rfind("btree:", 0) == 0) {
+    int factor = engine.size() > 6 ? std::atoi(engine.c_str() + 6) : 2;
+    if (factor >= 2) {
+      return std::make_unique<TreeAdapter<BTree<int>>>(factor);
+    }
+  }
+  return nullptr;
+}
+
+int Usage() {
+  std::cerr << "usage: TreeExport [--keys N] [--order random|sequential] [--seed S]\n"
+               "                  [--engine avl|rb|splay|treap|scapegoat|veb|art|btree:F]\n"
+               "                  [--tile SIZE] --out PATH\n";
+  return 1;
+}
+
+int main(int argc, char *argv[]) {
+  int key_count = 1000;
+  std::string order = "random", engine = "btree:2", out_path;
+  uint64_t seed = 1;
+  double tile_size = 0;
+  for (int i = 1; i < argc; i++) {
+    std::string option = argv[i];
+    if (i + 1 == argc) {
+      return Usage();
+    }
+    std::string value = argv[++i];
+    if (option == "--keys") {
+      key_count = std::atoi(value.c_str());
+    } else if (option == "--order") {
+      order = value;
+    } else if (option == "--seed") {
+      seed = std::strtoull(value.c_str(), nullptr, 10);
+    } else if (option == "--engine") {
+      engine = value;
+    } else if (option == "--tile") {
+      tile_size = std::atof(value.c_str());
+    } else if (option == "--out") {
+      out_path = value;
+    } else {
+      return Usage();
+    }
+  }
+  if (key_count < 0 || uint32_t(key_count) > KeyPermutation::kRange ||
+      (order != "random" && order != "sequential") || tile_size < 0 || out_path.empty()) {
+    return Usage();
+  }
+  std::unique_ptr<VisualizableTree<int>> tree = MakeTree(engine);
+  if (tree == nullptr) {
+    std::cerr << "unknown engine " << engine << '\n';
+    return 1;
+  }
+  KeyPermutation keys(seed);
+  for (int i = 0; i < key_count; i++) {
+    tree->Insert(order == "random" ? keys(i) : i + 1);
+  }
+
+  // The tree is freed once the snapshot is taken; the snapshot and its
+  // layout are all the export keeps.
+  VisualizationData<int> snapshot;
+  tree->GetVisualizationData(snapshot);
+  tree.reset();
+  SvgExporter exporter;
+  exporter.Layout(snapshot);
+  std::cerr << std::fixed << std::setprecision(0) << "drawing of " << exporter.Width() << " x " << exporter.Height() << " pixels\n";
+  if (tile_size == 0) {
+    std::ofstream out(out_path);
+    if (!exporter.Write(out)) {
+      std::cerr << "cannot write " << out_path << '\n';
+      return 1;
+    }
+  } else {
+    int tiles = exporter.WriteTiles(out_path, tile_size);
+    if (tiles < 0) {
+      std::cerr << "cannot write the tiles of " << out_path << '\n';
+      return 1;
+    }
+    std::cerr << tiles << " tiles\n";
+  }
+  return 0;
+}
@@ -2,12 +2,36 @@
 #define AVLTREE_IMPL
 
 #include "AVLTree.h"
+#include <type_traits>
+#include <vector>
+#include <tuple>
+#include <utility>
 #include <algorithm>
 #include <cassert>
+#include <cstdlib>
 
-template <typename T>
-AVLTree<T>::Node* AVLTree<T>::RotateLeft(Node *x) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+AVLTree<T, Compare, Augment, Trace>::~AVLTree() {
+  std::vector<Node*> stack;
+  if (root_ != nullptr) {
+    stack.push_back(root_);
+  }
+  while (!stack.empty()) {
+    Node *node = stack.back();
+    stack.pop_back();
+    for (Node *child : {node->left_, node->right_}) {
+      if (child != nullptr) {
+        stack.push_back(child);
+      }
+    }
+    delete node;
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+AVLTree<T, Compare, Augment, Trace>::Node* AVLTree<T, Compare, Augment, Trace>::RotateLeft(Node *x) {
   Node *y = x->right_, *beta = y->left_;
+  trace_.Record(TraceEvent::kRotateLeft, x, y);
   if (x->parent_) {
     if (x->parent_->left_ == x) {
       x->parent_->left_ = y; 
@@ -29,9 +53,10 @@ AVLTree<T>::Node* AVLTree<T>::RotateLeft(Node *x) {
   return y;
 }
 
-template <typename T>
-AVLTree<T>::Node* AVLTree<T>::RotateRight(Node *x) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+AVLTree<T, Compare, Augment, Trace>::Node* AVLTree<T, Compare, Augment, Trace>::RotateRight(Node *x) {
   Node *y = x->left_, *beta = y->right_;
+  trace_.Record(TraceEvent::kRotateRight, x, y);
   if (x->parent_) {
     if (x->parent_->left_ == x) {
       x->parent_->left_ = y;
@@ -53,19 +78,24 @@ AVLTree<T>::Node* AVLTree<T>::RotateRight(Node *x) {
   return y;
 }
 
-template <typename T>
-int AVLTree<T>::GetHeight(Node *x) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+int AVLTree<T, Compare, Augment, Trace>::GetHeight(Node *x) {
   return x ? x->height_ : 0;
 }
 
-template <typename T>
-void AVLTree<T>::UpdateHeight(Node *x) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+void AVLTree<T, Compare, Augment, Trace>::UpdateHeight(Node *x) {
   assert(x->parent_ != x);
   x->height_ = std::max(GetHeight(x->left_), GetHeight(x->right_)) + 1;
+  if constexpr (Augment::kEnabled) {
+    const AugmentData *children[] = {x->left_ ? &x->left_->augment_ : nullptr,
+                                     x->right_ ? &x->right_->augment_ : nullptr};
+    Augment::template Update<T>(x->augment_, {&x->value, 1}, children);
+  }
 }
 
-template <typename T>
-AVLTree<T>::Node* AVLTree<T>::Fix(Node *x) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+AVLTree<T, Compare, Augment, Trace>::Node* AVLTree<T, Compare, Augment, Trace>::Fix(Node *x) {
   int diff_cur = GetHeight(x->left_) - GetHeight(x->right_);
   if (diff_cur < -1) {
     int diff_down = GetHeight(x->right_->left_) - GetHeight(x->right_->right_);
@@ -84,55 +114,117 @@ AVLTree<T>::Node* AVLTree<T>::Fix(Node *x) {
   return x;
 }
 
-template <typename T>
-AVLTree<T>::Node* AVLTree<T>::FindNode(T value) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+AVLTree<T, Compare, Augment, Trace>::Node* AVLTree<T, Compare, Augment, Trace>::FindNode(T value) {
   Node *node = root_;
   while (node) {
-    if (value < node->value) {
+    trace_.Record(TraceEvent::kVisit, node);
+    if (less_(value, node->value)) {
       node = node->left_;
-    } else if (value == node->value) {
-      return node;
-    } else {
+    } else if (less_(node->value, value)) {
       node = node->right_;
+    } else {
+      return node;
     }
   }
   return node;
 }
 
-template <typename T>
-void AVLTree<T>::Insert(T value) {
-  if (root_) {
-    Node *node = root_, *parent = nullptr;
-    while (node) {
-      if (value < node->value) {
-        parent = node;
-        node = node->left_;
-      } else if (value == node->value) {
-        return;
-      } else {
-        parent = node;
-        node = node->right_;
-      }
+template <typename T, typename Compare, typename Augment, typename Trace>
+bool AVLTree<T, Compare, Augment, Trace>::FingerHolds(T value) {
+  return finger_ != nullptr && (finger_prev_ == nullptr || less_(finger_prev_->value, value)) &&
+         (finger_next_ == nullptr || less_(value, finger_next_->value));
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+AVLTree<T, Compare, Augment, Trace>::Node* AVLTree<T, Compare, Augment, Trace>::Climb(Node *hint, T value,
+                                                                                    Node *&prev, Node *&next) {
+  // Past the hint, the subtree of a node is bounded on that side by the
+  // first ancestor entered from the other side.
+  Node *node = hint;
+  if (less_(node->value, value)) {
+    while (node->parent_ && (node->parent_->right_ == node || !less_(value, node->parent_->value))) {
+      node = node->parent_;
+    }
+    next = node->parent_;
+  } else if (less_(value, node->value)) {
+    while (node->parent_ && (node->parent_->left_ == node || !less_(node->parent_->value, value))) {
+      node = node->parent_;
     }
-    node = parent;
-    if (value < node->value) {
-      node->left_ = new Node(value);
-      node->left_->parent_ = node;
+    prev = node->parent_;
+  }
+  return node;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void AVLTree<T, Compare, Augment, Trace>::Insert(T value) {
+  Insert(FingerHolds(value) ? finger_ : nullptr, value);
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+AVLTree<T, Compare, Augment, Trace>::Node* AVLTree<T, Compare, Augment, Trace>::Insert(Node *hint, T value) {
+  trace_.Record(TraceEvent::kInsert, nullptr);
+  Node *node = root_, *prev = nullptr, *next = nullptr;
+  if (hint != nullptr && hint == finger_ && FingerHolds(value)) {
+    // The place is below the finger or below its neighbour inside its
+    // subtree, which has no child on that side. The finger bounds value on
+    // one side, the neighbour on the other.
+    if (less_(finger_->value, value)) {
+      prev = finger_, next = finger_next_;
+      node = finger_->right_ ? finger_next_ : finger_;
+    } else if (less_(value, finger_->value)) {
+      prev = finger_prev_, next = finger_;
+      node = finger_->left_ ? finger_prev_ : finger_;
     } else {
-      node->right_ = new Node(value);
-      node->right_->parent_ = node;
+      node = finger_;
     }
-    while (node) {
-      UpdateHeight(node);
-      node = Fix(node)->parent_;
+  } else if (hint != nullptr) {
+    node = Climb(hint, value, prev, next);
+  }
+  Node *parent = nullptr;
+  while (node) {
+    trace_.Record(TraceEvent::kVisit, node);
+    if (less_(value, node->value)) {
+      parent = node, next = node;
+      node = node->left_;
+    } else if (less_(node->value, value)) {
+      parent = node, prev = node;
+      node = node->right_;
+    } else {
+      return node;
     }
+  }
+  Node *leaf = new Node(value);
+  leaf->parent_ = parent;
+  UpdateHeight(leaf);
+  finger_ = leaf, finger_prev_ = prev, finger_next_ = next;
+  if (parent == nullptr) {
+    root_ = leaf;
+    return leaf;
+  }
+  if (less_(value, parent->value)) {
+    parent->left_ = leaf;
   } else {
-    root_ = new Node(value);
+    parent->right_ = leaf;
   }
+  // Above a subtree whose height is back to what it was nothing changes,
+  // but the augment data.
+  for (node = parent; node != nullptr;) {
+    int height = node->height_;
+    UpdateHeight(node);
+    node = Fix(node);
+    if (!Augment::kEnabled && node->height_ == height) {
+      break;
+    }
+    node = node->parent_;
+  }
+  return leaf;
 }
 
-template <typename T>
-void AVLTree<T>::Erase(Node* node) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+void AVLTree<T, Compare, Augment, Trace>::Erase(Node* node) {
+  // Values move between nodes below.
+  finger_ = finger_prev_ = finger_next_ = nullptr;
   if (!node->right_) {
     if (node->parent_) {
       Node* par = node->parent_;
@@ -194,53 +286,132 @@ void AVLTree<T>::Erase(Node* node) {
   }
 }
 
-template <typename T>
-bool AVLTree<T>::InvariantCheck() {
-  auto DFS = [&](auto&& self, Node *node) -> bool {
-    if (node == nullptr) {
-      return true;
-    }
+template <typename T, typename Compare, typename Augment, typename Trace>
+bool AVLTree<T, Compare, Augment, Trace>::InvariantCheck() {
+  std::vector<Node*> stack;
+  if (root_ != nullptr) {
+    stack.push_back(root_);
+  }
+  while (!stack.empty()) {
+    Node *node = stack.back();
+    stack.pop_back();
     if (std::abs(GetHeight(node->left_) - GetHeight(node->right_)) > 1) {
       return false;
     }
-    return self(self, node->left_) && self(self, node->right_);
-  };
-  return DFS(DFS, root_);
+    for (Node *child : {node->left_, node->right_}) {
+      if (child != nullptr) {
+        stack.push_back(child);
+      }
+    }
+  }
+  return true;
 }
 
-template <typename T>
-void AVLTree<T>::Erase(T value) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+void AVLTree<T, Compare, Augment, Trace>::Erase(T value) {
+  trace_.Record(TraceEvent::kErase, nullptr);
   Node *node = FindNode(value);
   if (node != nullptr) {
     Erase(node);
   }
 }
 
-template <typename T>
-bool AVLTree<T>::Find(T value) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+bool AVLTree<T, Compare, Augment, Trace>::Find(T value) {
+  trace_.Record(TraceEvent::kFind, nullptr);
   selected_ = FindNode(value);
   return selected_ != nullptr;
 }
 
-template <typename T>
-VisualizationData* AVLTree<T>::GetVisualizationData() {
-  auto DFS = [&](auto&& self, Node *node) -> VisualizationData* {
-    if (node == nullptr) {
-      return nullptr;
+template <typename T, typename Compare, typename Augment, typename Trace>
+size_t AVLTree<T, Compare, Augment, Trace>::FindBatch(std::span<const T> keys, std::span<uint8_t> results) {
+  if constexpr (Trace::kEnabled) {
+    // One by one, so that the events of every lookup stay together.
+    return BatchOperations<AVLTree, T>::FindBatch(keys, results);
+  } else {
+    return InterleaveLookups(keys, results, root_, [this](Node *&node, const T &key) {
+      using Step = std::pair<BatchStep, const void*>;
+      if (node == nullptr) {
+        return Step(BatchStep::kMissing, nullptr);
+      }
+      if (less_(key, node->value)) {
+        node = node->left_;
+      } else if (less_(node->value, key)) {
+        node = node->right_;
+      } else {
+        return Step(BatchStep::kFound, nullptr);
+      }
+      return Step(BatchStep::kPending, node);
+    });
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void AVLTree<T, Compare, Augment, Trace>::GetVisualizationData(VisualizationData<T> &data) {
+  data.Clear();
+  // Preorder with an explicit stack: node, index of its parent, child slot.
+  std::vector<std::tuple<Node*, int, int>> stack;
+  if (root_ != nullptr) {
+    stack.emplace_back(root_, -1, 0);
+  }
+  while (!stack.empty()) {
+    auto [node, parent, slot] = stack.back();
+    stack.pop_back();
+    int index = data.AddNode(reinterpret_cast<uintptr_t>(node), 2);
+    data.AddKey(node->value, VisualizationData<T>::kPlain, node == selected_);
+    if (parent != -1) {
+      data.SetChild(parent, slot, index);
     }
-    VisualizationData *data = new VisualizationData();
-    data->keys.push_back(std::to_string(node->value));
-    if (node == selected_) {
-      data->colors.push_back({QColor(Qt::green), QColor(Qt::white)});
-    } else {
-      data->colors.push_back({QColor("#CDCDCE"), QColor(Qt::black)});
+    if (node->right_ != nullptr) {
+      stack.emplace_back(node->right_, index, 1);
     }
-    data->children = {self(self, node->left_), self(self, node->right_)};
-    return data;
-  };
-  VisualizationData* data = DFS(DFS, root_);
+    if (node->left_ != nullptr) {
+      stack.emplace_back(node->left_, index, 0);
+    }
+  }
   selected_ = nullptr;
-  return data;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+const TraceRecorder* AVLTree<T, Compare, Augment, Trace>::GetTrace() const {
+  if constexpr (std::is_same_v<Trace, TraceRecorder>) {
+    return &trace_;
+  } else {
+    return nullptr;
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+const Trace& AVLTree<T, Compare, Augment, Trace>::GetTracePolicy() const {
+  return trace_;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+TreeStats AVLTree<T, Compare, Augment, Trace>::GetStats() const {
+  TreeStats stats;
+  std::vector<std::pair<Node*, int>> stack;
+  if (root_ != nullptr) {
+    stack.emplace_back(root_, 1);
+  }
+  while (!stack.empty()) {
+    auto [node, depth] = stack.back();
+    stack.pop_back();
+    stats.keys++;
+    stats.height = std::max(stats.height, depth);
+    for (Node *child : {node->left_, node->right_}) {
+      if (child != nullptr) {
+        stack.emplace_back(child, depth + 1);
+      }
+    }
+  }
+  stats.nodes = stats.keys;
+  stats.bytes = stats.nodes * sizeof(Node);
+  return stats;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+AVLTree<T, Compare, Augment, Trace>::AugmentData AVLTree<T, Compare, Augment, Trace>::GetAugment() const {
+  return root_ != nullptr ? root_->augment_ : AugmentData();
 }
 
 #endif // AVLTREE_IMPL
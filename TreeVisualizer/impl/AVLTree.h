@@ -1,11 +1,15 @@
 #ifndef AVLTREE_H
 #define AVLTREE_H
 
-#include "Visualization.h"
+#include "TreeEngine.h"
 
-template <typename T>
-class AVLTree : public VisualizableTree<T> {
+// Augment: see TreeEngine.h; Trace: see OperationTrace.h.
+template <typename T, typename Compare = std::less<T>, typename Augment = NoAugment, typename Trace = NoTrace>
+class AVLTree : public BatchOperations<AVLTree<T, Compare, Augment, Trace>, T> {
  public:
+  using KeyType = T;
+  using AugmentData = typename Augment::Data;
+
   class Node {
     friend class AVLTree;
    public:
@@ -19,26 +23,63 @@ class AVLTree : public VisualizableTree<T> {
     Node *left_ = nullptr, *right_ = nullptr;
     Node *parent_ = nullptr;
     int height_ = 1;
+    [[no_unique_address]] AugmentData augment_;
   };
  
   AVLTree() = default;
 
-  void Insert(T value) override;
+  AVLTree(const AVLTree&) = delete;
+  AVLTree& operator=(const AVLTree&) = delete;
+
+  ~AVLTree();
+
+  // Links keys that fall next to the last inserted one (sorted runs) without
+  // a search; others are searched from the root.
+  void Insert(T value);
+
+  // Searches from hint, a node of this tree or nullptr for the root: goes up
+  // only until an ancestor bounds value, then down. Returns the node of
+  // value.
+  Node* Insert(Node *hint, T value);
 
   void Erase(Node* node);
-  void Erase(T value) override;
+  void Erase(T value);
 
   Node* FindNode(T value);
-  bool Find(T value) override;
+  bool Find(T value);
+
+  // Interleaves the lookups unless the engine records a trace.
+  size_t FindBatch(std::span<const T> keys, std::span<uint8_t> results);
  
-  VisualizationData* GetVisualizationData() override;
+  void GetVisualizationData(VisualizationData<T> &data);
+
+  const TraceRecorder* GetTrace() const;
+
+  const Trace& GetTracePolicy() const;
+
+  TreeStats GetStats() const;
+
+  // Augment data of the whole tree.
+  AugmentData GetAugment() const;
 
   bool InvariantCheck();
 
  private:
   Node *root_ = nullptr, *selected_ = nullptr;
+  // The last inserted node and its neighbours in key order, nullptr past the
+  // ends. Rotations keep the order, erases reset them.
+  Node *finger_ = nullptr, *finger_prev_ = nullptr, *finger_next_ = nullptr;
+  [[no_unique_address]] Compare less_;
+  [[no_unique_address]] Trace trace_;
+
+  bool FingerHolds(T value);
+
+  // Lowest ancestor of hint whose subtree may hold value; sets the bound
+  // found on the way up.
+  Node* Climb(Node *hint, T value, Node *&prev, Node *&next);
 
   int GetHeight(Node* node);
+  // Also updates the augment data.
   void UpdateHeight(Node* node);
 
   Node* RotateLeft(Node *node);
@@ -0,0 +1,561 @@
+#ifndef ARTTREE_IMPL
+#define ARTTREE_IMPL
+
+#include "ArtTree.h"
+#include <bit>
+#include <cstring>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+ArtTree<T, Compare, Augment, Trace>::~ArtTree() {
+  std::vector<Node*> stack;
+  if (root_ != nullptr) {
+    stack.push_back(root_);
+  }
+  while (!stack.empty()) {
+    Node *node = stack.back();
+    stack.pop_back();
+    ForEachChild(node, [&stack](uint8_t, Node *child) {
+      stack.push_back(child);
+    });
+    Free(node);
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+ArtTree<T, Compare, Augment, Trace>::Bits ArtTree<T, Compare, Augment, Trace>::ToBits(T key) {
+  if constexpr (std::is_signed_v<T>) {
+    return Bits(key) ^ Bits(Bits(1) << (kBytes * 8 - 1));
+  } else {
+    return key;
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+T ArtTree<T, Compare, Augment, Trace>::FromBits(Bits bits) {
+  if constexpr (std::is_signed_v<T>) {
+    return T(Bits(bits ^ Bits(Bits(1) << (kBytes * 8 - 1))));
+  } else {
+    return bits;
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+uint8_t ArtTree<T, Compare, Augment, Trace>::Byte(Bits key, int depth) {
+  return uint8_t(key >> (kBytes - 1 - depth) * 8);
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+int ArtTree<T, Compare, Augment, Trace>::Match(const Node *node, Bits key, int depth) {
+  int matched = 0;
+  while (matched < node->prefix_length && node->prefix[matched] == Byte(key, depth + matched)) {
+    matched++;
+  }
+  return matched;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void ArtTree<T, Compare, Augment, Trace>::Free(Node *node) {
+  switch (node->kind) {
+    case kLeaf:
+      delete static_cast<Leaf*>(node);
+      break;
+    case kNode4:
+      delete static_cast<Node4*>(node);
+      break;
+    case kNode16:
+      delete static_cast<Node16*>(node);
+      break;
+    case kNode48:
+      delete static_cast<Node48*>(node);
+      break;
+    case kNode256:
+      delete static_cast<Node256*>(node);
+      break;
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+size_t ArtTree<T, Compare, Augment, Trace>::Size(const Node *node) {
+  constexpr size_t kSizes[] = {sizeof(Leaf), sizeof(Node4), sizeof(Node16), sizeof(Node48), sizeof(Node256)};
+  return kSizes[node->kind];
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+ArtTree<T, Compare, Augment, Trace>::Node** ArtTree<T, Compare, Augment, Trace>::FindChild(Node *node, uint8_t byte) {
+  switch (node->kind) {
+    case kNode4: {
+      Node4 *inner = static_cast<Node4*>(node);
+      for (int i = 0; i < inner->count; i++) {
+        if (inner->keys[i] == byte) {
+          return &inner->children[i];
+        }
+      }
+      return nullptr;
+    }
+    case kNode16: {
+      Node16 *inner = static_cast<Node16*>(node);
+#ifdef __SSE2__
+      // All 16 bytes compared at once; the mask drops the unused ones.
+      __m128i equal = _mm_cmpeq_epi8(_mm_set1_epi8(char(byte)),
+                                     _mm_loadu_si128(reinterpret_cast<const __m128i*>(inner->keys)));
+      unsigned mask = unsigned(_mm_movemask_epi8(equal)) & ((1u << inner->count) - 1);
+      return mask != 0 ? &inner->children[std::countr_zero(mask)] : nullptr;
+#else
+      uint8_t *end = inner->keys + inner->count, *it = std::lower_bound(inner->keys, end, byte);
+      return it != end && *it == byte ? &inner->children[it - inner->keys] : nullptr;
+#endif
+    }
+    case kNode48: {
+      Node48 *inner = static_cast<Node48*>(node);
+      return inner->positions[byte] != 0 ? &inner->children[inner->positions[byte] - 1] : nullptr;
+    }
+    case kNode256: {
+      Node256 *inner = static_cast<Node256*>(node);
+      return inner->children[byte] != nullptr ? &inner->children[byte] : nullptr;
+    }
+    default:
+      return nullptr;
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+template <typename Function>
+void ArtTree<T, Compare, Augment, Trace>::ForEachChild(Node *node, Function function) {
+  switch (node->kind) {
+    case kNode4: {
+      Node4 *inner = static_cast<Node4*>(node);
+      for (int i = 0; i < inner->count; i++) {
+        function(inner->keys[i], inner->children[i]);
+      }
+      break;
+    }
+    case kNode16: {
+      Node16 *inner = static_cast<Node16*>(node);
+      for (int i = 0; i < inner->count; i++) {
+        function(inner->keys[i], inner->children[i]);
+      }
+      break;
+    }
+    case kNode48: {
+      Node48 *inner = static_cast<Node48*>(node);
+      for (int byte = 0; byte < 256; byte++) {
+        if (inner->positions[byte] != 0) {
+          function(uint8_t(byte), inner->children[inner->positions[byte] - 1]);
+        }
+      }
+      break;
+    }
+    case kNode256: {
+      Node256 *inner = static_cast<Node256*>(node);
+      for (int byte = 0; byte < 256; byte++) {
+        if (inner->children[byte] != nullptr) {
+          function(uint8_t(byte), inner->children[byte]);
+        }
+      }
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void ArtTree<T, Compare, Augment, Trace>::CopyHeader(const Node *from, Node *to) {
+  to->prefix_length = from->prefix_length;
+  std::memcpy(to->prefix, from->prefix, sizeof(to->prefix));
+  to->augment = from->augment;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+ArtTree<T, Compare, Augment, Trace>::Node* ArtTree<T, Compare, Augment, Trace>::Grow(Node **slot) {
+  Node *node = *slot, *grown = nullptr;
+  if (node->kind == kNode4) {
+    grown = new Node16();
+  } else if (node->kind == kNode16) {
+    grown = new Node48();
+  } else {
+    grown = new Node256();
+  }
+  CopyHeader(node, grown);
+  ForEachChild(node, [&grown](uint8_t byte, Node *child) {
+    AddChild(&grown, byte, child);
+  });
+  Free(node);
+  *slot = grown;
+  return grown;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void ArtTree<T, Compare, Augment, Trace>::Shrink(Node **slot) {
+  Node *node = *slot;
+  if (node->kind == kNode4) {
+    // A single child takes the place of the node, with the node's prefix and
+    // the child's byte prepended to its own.
+    Node4 *inner = static_cast<Node4*>(node);
+    Node *child = inner->children[0];
+    if (child->kind != kLeaf) {
+      int length = inner->prefix_length + 1;
+      std::memmove(child->prefix + length, child->prefix, child->prefix_length);
+      std::memcpy(child->prefix, inner->prefix, inner->prefix_length);
+      child->prefix[inner->prefix_length] = inner->keys[0];
+      child->prefix_length += length;
+    }
+    Free(node);
+    *slot = child;
+    return;
+  }
+  Node *shrunk = nullptr;
+  if (node->kind == kNode16) {
+    shrunk = new Node4();
+  } else if (node->kind == kNode48) {
+    shrunk = new Node16();
+  } else {
+    shrunk = new Node48();
+  }
+  CopyHeader(node, shrunk);
+  ForEachChild(node, [&shrunk](uint8_t byte, Node *child) {
+    AddChild(&shrunk, byte, child);
+  });
+  Free(node);
+  *slot = shrunk;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void ArtTree<T, Compare, Augment, Trace>::AddChild(Node **slot, uint8_t byte, Node *child) {
+  Node *node = *slot;
+  constexpr int kCapacity[] = {0, 4, 16, 48, 256};
+  if (node->count == kCapacity[node->kind]) {
+    node = Grow(slot);
+  }
+  if (node->kind == kNode4 || node->kind == kNode16) {
+    // Node4 and Node16 share the layout of the sorted arrays but their size.
+    uint8_t *keys = node->kind == kNode4 ? static_cast<Node4*>(node)->keys : static_cast<Node16*>(node)->keys;
+    Node **children = node->kind == kNode4 ? static_cast<Node4*>(node)->children
+                                           : static_cast<Node16*>(node)->children;
+    int position = std::upper_bound(keys, keys + node->count, byte) - keys;
+    std::memmove(keys + position + 1, keys + position, node->count - position);
+    std::memmove(children + position + 1, children + position, (node->count - position) * sizeof(Node*));
+    keys[position] = byte;
+    children[position] = child;
+  } else if (node->kind == kNode48) {
+    Node48 *inner = static_cast<Node48*>(node);
+    inner->children[inner->count] = child;
+    inner->positions[byte] = uint8_t(inner->count + 1);
+  } else {
+    static_cast<Node256*>(node)->children[byte] = child;
+  }
+  node->count++;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void ArtTree<T, Compare, Augment, Trace>::RemoveChild(Node **slot, uint8_t byte) {
+  Node *node = *slot;
+  if (node->kind == kNode4 || node->kind == kNode16) {
+    uint8_t *keys = node->kind == kNode4 ? static_cast<Node4*>(node)->keys : static_cast<Node16*>(node)->keys;
+    Node **children = node->kind == kNode4 ? static_cast<Node4*>(node)->children
+                                           : static_cast<Node16*>(node)->children;
+    int position = std::find(keys, keys + node->count, byte) - keys;
+    std::memmove(keys + position, keys + position + 1, node->count - position - 1);
+    std::memmove(children + position, children + position + 1, (node->count - position - 1) * sizeof(Node*));
+  } else if (node->kind == kNode48) {
+    // The last child moves into the freed slot to keep the positions dense.
+    Node48 *inner = static_cast<Node48*>(node);
+    int freed = inner->positions[byte] - 1, last = inner->count - 1;
+    inner->positions[byte] = 0;
+    if (freed != last) {
+      inner->children[freed] = inner->children[last];
+      *std::find(inner->positions, inner->positions + 256, uint8_t(last + 1)) = uint8_t(freed + 1);
+    }
+  } else {
+    static_cast<Node256*>(node)->children[byte] = nullptr;
+  }
+  node->count--;
+  // Below the capacity of the next smaller kind, with some slack so that a
+  // key going back and forth does not resize every time.
+  constexpr int kShrinkAt[] = {0, 1, 3, 12, 37};
+  if (node->count == kShrinkAt[node->kind]) {
+    Shrink(slot);
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+ArtTree<T, Compare, Augment, Trace>::Leaf* ArtTree<T, Compare, Augment, Trace>::NewLeaf(T value) {
+  Leaf *leaf = new Leaf(value);
+  UpdateAugment(leaf);
+  return leaf;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void ArtTree<T, Compare, Augment, Trace>::UpdateAugment(Node *node) {
+  if constexpr (Augment::kEnabled) {
+    if (node->kind == kLeaf) {
+      Augment::template Update<T>(node->augment, {&static_cast<Leaf*>(node)->key, 1}, {});
+      return;
+    }
+    child_augments_.clear();
+    ForEachChild(node, [this](uint8_t, Node *child) {
+      child_augments_.push_back(&child->augment);
+    });
+    Augment::template Update<T>(node->augment, {}, child_augments_);
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void ArtTree<T, Compare, Augment, Trace>::Insert(T value) {
+  trace_.Record(TraceEvent::kInsert, nullptr);
+  Bits key = ToBits(value);
+  path_.clear();
+  Node **slot = &root_;
+  for (int depth = 0;;) {
+    Node *node = *slot;
+    if (node == nullptr) {
+      *slot = NewLeaf(value);
+      break;
+    }
+    trace_.Record(TraceEvent::kVisit, node);
+    if constexpr (Augment::kEnabled) {
+      path_.push_back(slot);
+    }
+    if (node->kind == kLeaf) {
+      Leaf *leaf = static_cast<Leaf*>(node);
+      if (leaf->key == value) {
+        path_.clear();
+        return;
+      }
+      // Lazy expansion ends here: a Node4 over the bytes both keys share.
+      Bits other = ToBits(leaf->key);
+      Node4 *inner = new Node4();
+      while (Byte(key, depth + inner->prefix_length) == Byte(other, depth + inner->prefix_length)) {
+        inner->prefix[inner->prefix_length] = Byte(key, depth + inner->prefix_length);
+        inner->prefix_length++;
+      }
+      *slot = inner;
+      AddChild(slot, Byte(other, depth + inner->prefix_length), leaf);
+      AddChild(slot, Byte(key, depth + inner->prefix_length), NewLeaf(value));
+      break;
+    }
+    int matched = Match(node, key, depth);
+    if (matched < node->prefix_length) {
+      // The key leaves the compressed path: a Node4 over the matched part,
+      // with the node below it under its next prefix byte.
+      Node4 *inner = new Node4();
+      inner->prefix_length = uint8_t(matched);
+      std::memcpy(inner->prefix, node->prefix, matched);
+      uint8_t byte = node->prefix[matched];
+      node->prefix_length -= matched + 1;
+      std::memmove(node->prefix, node->prefix + matched + 1, node->prefix_length);
+      *slot = inner;
+      AddChild(slot, byte, node);
+      AddChild(slot, Byte(key, depth + matched), NewLeaf(value));
+      break;
+    }
+    depth += node->prefix_length;
+    Node **child = FindChild(node, Byte(key, depth));
+    if (child == nullptr) {
+      AddChild(slot, Byte(key, depth), NewLeaf(value));
+      break;
+    }
+    slot = child;
+    depth++;
+  }
+  // The positions stay valid: only the last node on the path may have been
+  // replaced, and its slot is in its parent.
+  for (auto it = path_.rbegin(); it != path_.rend(); ++it) {
+    UpdateAugment(**it);
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void ArtTree<T, Compare, Augment, Trace>::Erase(T value) {
+  trace_.Record(TraceEvent::kErase, nullptr);
+  Bits key = ToBits(value);
+  path_.clear();
+  Node **slot = &root_;
+  int depth = 0;
+  while (true) {
+    Node *node = *slot;
+    if (node == nullptr) {
+      return;
+    }
+    trace_.Record(TraceEvent::kVisit, node);
+    if (node->kind == kLeaf) {
+      if (static_cast<Leaf*>(node)->key != value) {
+        return;
+      }
+      break;
+    }
+    if (Match(node, key, depth) < node->prefix_length) {
+      return;
+    }
+    depth += node->prefix_length;
+    Node **child = FindChild(node, Byte(key, depth));
+    if (child == nullptr) {
+      return;
+    }
+    path_.push_back(slot);
+    slot = child;
+    depth++;
+  }
+  if (*slot == selected_) {
+    selected_ = nullptr;
+  }
+  Free(*slot);
+  if (path_.empty()) {
+    root_ = nullptr;
+    return;
+  }
+  RemoveChild(path_.back(), Byte(key, depth - 1));
+  for (auto it = path_.rbegin(); it != path_.rend(); ++it) {
+    UpdateAugment(**it);
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+bool ArtTree<T, Compare, Augment, Trace>::Find(T value) {
+  trace_.Record(TraceEvent::kFind, nullptr);
+  Bits key = ToBits(value);
+  selected_ = nullptr;
+  Node *node = root_;
+  for (int depth = 0; node != nullptr; depth++) {
+    trace_.Record(TraceEvent::kVisit, node);
+    if (node->kind == kLeaf) {
+      if (static_cast<Leaf*>(node)->key == value) {
+        selected_ = static_cast<Leaf*>(node);
+      }
+      break;
+    }
+    if (Match(node, key, depth) < node->prefix_length) {
+      break;
+    }
+    depth += node->prefix_length;
+    Node **child = FindChild(node, Byte(key, depth));
+    node = child != nullptr ? *child : nullptr;
+  }
+  return selected_ != nullptr;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+size_t ArtTree<T, Compare, Augment, Trace>::FindBatch(std::span<const T> keys, std::span<uint8_t> results) {
+  if constexpr (Trace::kEnabled) {
+    // One by one, so that the events of every lookup stay together.
+    return BatchOperations<ArtTree, T>::FindBatch(keys, results);
+  } else {
+    struct Cursor {
+      Node *node;
+      int depth;
+    };
+    return InterleaveLookups(keys, results, Cursor{root_, 0}, [](Cursor &cursor, const T &value) {
+      using Step = std::pair<BatchStep, const void*>;
+      Node *node = cursor.node;
+      if (node == nullptr) {
+        return Step(BatchStep::kMissing, nullptr);
+      }
+      if (node->kind == kLeaf) {
+        return Step(static_cast<Leaf*>(node)->key == value ? BatchStep::kFound : BatchStep::kMissing, nullptr);
+      }
+      Bits key = ToBits(value);
+      if (Match(node, key, cursor.depth) < node->prefix_length) {
+        return Step(BatchStep::kMissing, nullptr);
+      }
+      int depth = cursor.depth + node->prefix_length;
+      Node **child = FindChild(node, Byte(key, depth));
+      if (child == nullptr) {
+        return Step(BatchStep::kMissing, nullptr);
+      }
+      cursor = {*child, depth + 1};
+      return Step(BatchStep::kPending, cursor.node);
+    });
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void ArtTree<T, Compare, Augment, Trace>::GetVisualizationData(VisualizationData<T> &data) {
+  data.Clear();
+  // Preorder with an explicit stack: node, its depth and the key bytes above
+  // it, index of its parent, child slot.
+  std::vector<std::tuple<Node*, int, Bits, int, int>> stack;
+  std::vector<std::pair<Bits, Node*>> children;
+  if (root_ != nullptr) {
+    stack.emplace_back(root_, 0, 0, -1, 0);
+  }
+  while (!stack.empty()) {
+    auto [node, depth, prefix, parent, slot] = stack.back();
+    stack.pop_back();
+    if (node->kind == kLeaf) {
+      Leaf *leaf = static_cast<Leaf*>(node);
+      int index = data.AddNode(reinterpret_cast<uintptr_t>(node), 0);
+      data.AddKey(leaf->key, VisualizationData<T>::kPlain, leaf == selected_);
+      if (parent != -1) {
+        data.SetChild(parent, slot, index);
+      }
+      continue;
+    }
+    int index = data.AddNode(reinterpret_cast<uintptr_t>(node), node->count);
+    for (int i = 0; i < node->prefix_length; i++, depth++) {
+      prefix |= Bits(Bits(node->prefix[i]) << (kBytes - 1 - depth) * 8);
+    }
+    children.clear();
+    ForEachChild(node, [&children, prefix, depth](uint8_t byte, Node *child) {
+      children.emplace_back(prefix | Bits(Bits(byte) << (kBytes - 1 - depth) * 8), child);
+    });
+    for (auto [start, child] : children) {
+      data.AddKey(FromBits(start), VisualizationData<T>::kBlack, false, false);
+    }
+    if (parent != -1) {
+      data.SetChild(parent, slot, index);
+    }
+    for (int i = int(children.size()) - 1; i >= 0; i--) {
+      stack.emplace_back(children[i].second, depth + 1, children[i].first, index, i);
+    }
+  }
+  selected_ = nullptr;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+const TraceRecorder* ArtTree<T, Compare, Augment, Trace>::GetTrace() const {
+  if constexpr (std::is_same_v<Trace, TraceRecorder>) {
+    return &trace_;
+  } else {
+    return nullptr;
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+const Trace& ArtTree<T, Compare, Augment, Trace>::GetTracePolicy() const {
+  return trace_;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+TreeStats ArtTree<T, Compare, Augment, Trace>::GetStats() const {
+  TreeStats stats;
+  std::vector<std::pair<Node*, int>> stack;
+  if (root_ != nullptr) {
+    stack.emplace_back(root_, 1);
+  }
+  while (!stack.empty()) {
+    auto [node, depth] = stack.back();
+    stack.pop_back();
+    stats.nodes++;
+    stats.keys += node->kind == kLeaf;
+    stats.bytes += Size(node);
+    stats.height = std::max(stats.height, depth);
+    ForEachChild(node, [&stack, depth](uint8_t, Node *child) {
+      stack.emplace_back(child, depth + 1);
+    });
+  }
+  return stats;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+ArtTree<T, Compare, Augment, Trace>::AugmentData ArtTree<T, Compare, Augment, Trace>::GetAugment() const {
+  return root_ != nullptr ? root_->augment : AugmentData();
+}
+
+#endif // ARTTREE_IMPL
@@ -0,0 +1,163 @@
+#ifndef ARTTREE_H
+#define ARTTREE_H
+
+#include <type_traits>
+#include <vector>
+#include "TreeEngine.h"
+
+// Adaptive radix tree (Leis et al.) over the bytes of integer keys, most
+// significant first. Inner nodes branch on one byte and come in four sizes,
+// grown and shrunk as children come and go: Node4 and Node16 keep sorted
+// byte arrays (Node16 is searched with SSE2 where available), Node48 maps
+// every byte to one of 48 slots and Node256 is a plain array. Bytes shared by
+// the whole subtree of a node are stored in the node instead of a chain of
+// single-child nodes (path compression), and a subtree with one key is just
+// its leaf (lazy expansion). A lookup costs at most one node per key byte,
+// however many keys there are.
+//
+// Keys are ordered as integers, so Compare must be std::less<T>.
+// Augment: see TreeEngine.h; Trace: see OperationTrace.h.
+template <typename T, typename Compare = std::less<T>, typename Augment = NoAugment, typename Trace = NoTrace>
+class ArtTree : public BatchOperations<ArtTree<T, Compare, Augment, Trace>, T> {
+  static_assert(std::is_integral_v<T>, "ArtTree keys are integers");
+  static_assert(std::is_same_v<Compare, std::less<T>>, "ArtTree keys are in numeric order");
+
+ public:
+  using KeyType = T;
+  using AugmentData = typename Augment::Data;
+
+  ArtTree() = default;
+
+  ArtTree(const ArtTree&) = delete;
+  ArtTree& operator=(const ArtTree&) = delete;
+
+  ~ArtTree();
+
+  void Insert(T value);
+
+  void Erase(T value);
+
+  bool Find(T value);
+
+  // Interleaves the lookups unless the engine records a trace.
+  size_t FindBatch(std::span<const T> keys, std::span<uint8_t> results);
+
+  // Inner nodes are drawn with the smallest key of every child's range, in
+  // black; leaves with their key.
+  void GetVisualizationData(VisualizationData<T> &data);
+
+  const TraceRecorder* GetTrace() const;
+
+  const Trace& GetTracePolicy() const;
+
+  TreeStats GetStats() const;
+
+  // Augment data of the whole tree.
+  AugmentData GetAugment() const;
+
+ private:
+  using Bits = std::make_unsigned_t<T>;
+
+  static constexpr int kBytes = sizeof(T);
+
+  enum Kind : uint8_t {
+    kLeaf,
+    kNode4,
+    kNode16,
+    kNode48,
+    kNode256
+  };
+
+  struct Node {
+    Kind kind;
+    uint8_t prefix_length = 0;
+    uint16_t count = 0;
+    // Key bytes skipped by path compression.
+    uint8_t prefix[kBytes] = {};
+    [[no_unique_address]] AugmentData augment;
+
+    explicit Node(Kind kind_) : kind(kind_) {}
+  };
+
+  struct Leaf : Node {
+    T key;
+
+    explicit Leaf(T key_) : Node(kLeaf), key(key_) {}
+  };
+
+  struct Node4 : Node {
+    uint8_t keys[4] = {};
+    Node *children[4] = {};
+
+    Node4() : Node(kNode4) {}
+  };
+
+  struct Node16 : Node {
+    uint8_t keys[16] = {};
+    Node *children[16] = {};
+
+    Node16() : Node(kNode16) {}
+  };
+
+  struct Node48 : Node {
+    // 1 + slot of the child of every byte, 0 for none.
+    uint8_t positions[256] = {};
+    Node *children[48] = {};
+
+    Node48() : Node(kNode48) {}
+  };
+
+  struct Node256 : Node {
+    Node *children[256] = {};
+
+    Node256() : Node(kNode256) {}
+  };
+
+  Node *root_ = nullptr;
+  Leaf *selected_ = nullptr;
+  [[no_unique_address]] Trace trace_;
+  // Slots of the nodes on the path of an update, root first, and scratch for
+  // Augment.
+  std::vector<Node**> path_;
+  std::vector<const AugmentData*> child_augments_;
+
+  // Order-preserving map to unsigned, and back.
+  static Bits ToBits(T key);
+  static T FromBits(Bits bits);
+
+  // Byte of key at depth, 0 being the most significant.
+  static uint8_t Byte(Bits key, int depth);
+
+  // Number of the prefix bytes of node that match key from depth on.
+  static int Match(const Node *node, Bits key, int depth);
+
+  static void Free(Node *node);
+
+  // Prefix and augment data, for a node changing its kind.
+  static void CopyHeader(const Node *from, Node *to);
+
+  static size_t Size(const Node *node);
+
+  // Slot of the child of node for byte, nullptr if there is none.
+  static Node** FindChild(Node *node, uint8_t byte);
+
+  // Calls function(byte, child) for the children of node in byte order.
+  template <typename Function>
+  static void ForEachChild(Node *node, Function function);
+
+  // Replaces the node in *slot by the next larger kind.
+  static Node* Grow(Node **slot);
+
+  // Replaces the node in *slot by the next smaller kind, or by its only child.
+  static void Shrink(Node **slot);
+
+  static void AddChild(Node **slot, uint8_t byte, Node *child);
+
+  static void RemoveChild(Node **slot, uint8_t byte);
+
+  Leaf* NewLeaf(T value);
+
+  void UpdateAugment(Node *node);
+};
+
+#endif // ARTTREE_H
@@ -2,67 +2,202 @@
 #define BTREE_IMPL
 
 #include "BTree.h"
+#include <type_traits>
+#include <vector>
+#include <tuple>
+#include <utility>
 #include <algorithm>
 #include <cassert>
 
-template <typename T>
-bool BTree<T>::Node::IsLeaf() {
+template <typename T, typename Compare, typename Augment, typename Trace>
+BTree<T, Compare, Augment, Trace>::~BTree() {
+  Release(root_);
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void BTree<T, Compare, Augment, Trace>::Release(Node *node) {
+  // Iterative, like the other whole-tree traversals.
+  std::vector<Node*> stack;
+  if (node != nullptr) {
+    stack.push_back(node);
+  }
+  while (!stack.empty()) {
+    node = stack.back();
+    stack.pop_back();
+    // The last holder frees the node and drops its references in turn.
+    if (node->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+      continue;
+    }
+    for (Node *child : node->children) {
+      if (child != nullptr) {
+        stack.push_back(child);
+      }
+    }
+    delete node;
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+BTree<T, Compare, Augment, Trace>::Node* BTree<T, Compare, Augment, Trace>::Own(Node *&slot) {
+  // Only this tree adds references, so a count of one stays one. A copy
+  // holds on to the children until they are owned in turn.
+  Node *node = slot;
+  if (node == nullptr || node->refs.load(std::memory_order_acquire) == 1) {
+    return node;
+  }
+  Node *copy = new Node();
+  copy->keys = node->keys;
+  copy->children = node->children;
+  copy->augment = node->augment;
+  for (Node *child : copy->children) {
+    if (child != nullptr) {
+      child->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  Release(node);
+  slot = copy;
+  return copy;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+BTree<T, Compare, Augment, Trace>::Snapshot BTree<T, Compare, Augment, Trace>::TakeSnapshot() {
+  finger_ = nullptr;
+  finger_low_.reset(), finger_high_.reset();
+  if (root_ != nullptr) {
+    root_->refs.fetch_add(1, std::memory_order_relaxed);
+  }
+  return Snapshot(root_);
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+bool BTree<T, Compare, Augment, Trace>::Node::IsLeaf() {
   return children[0] == nullptr;
 }
 
-template <typename T>
-bool BTree<T>::Follow(Node *&node, T key) {
-  auto iter = std::lower_bound(node->keys.begin(), node->keys.end(), key);
-  if (iter != node->keys.end() && *iter == key) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+void BTree<T, Compare, Augment, Trace>::UpdateAugment(Node *node) {
+  if constexpr (Augment::kEnabled) {
+    child_augments_.clear();
+    for (Node *child : node->children) {
+      child_augments_.push_back(child != nullptr ? &child->augment : nullptr);
+    }
+    Augment::template Update<T>(node->augment, node->keys, child_augments_);
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void BTree<T, Compare, Augment, Trace>::AddToPath(Node *node) {
+  if constexpr (Augment::kEnabled) {
+    if (path_.empty() || path_.back() != node) {
+      path_.push_back(node);
+    }
+  }
+}
+
+// Nodes off the path that a split, borrow or merge changes are updated right
+// away, their subtrees being final by then.
+template <typename T, typename Compare, typename Augment, typename Trace>
+void BTree<T, Compare, Augment, Trace>::UpdatePath() {
+  if constexpr (Augment::kEnabled) {
+    for (auto it = path_.rbegin(); it != path_.rend(); ++it) {
+      UpdateAugment(*it);
+    }
+    path_.clear();
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+bool BTree<T, Compare, Augment, Trace>::Follow(Node *&node, T key, int *position) {
+  trace_.Record(TraceEvent::kVisit, node);
+  auto iter = std::lower_bound(node->keys.begin(), node->keys.end(), key, less_);
+  if (iter != node->keys.end() && !less_(key, *iter)) {
     return false;
   }
+  if (position != nullptr) {
+    *position = iter - node->keys.begin();
+  }
   node = node->children[iter - node->keys.begin()];
   return true;
 }
 
-template <typename T>
-void BTree<T>::Insert(T value) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+void BTree<T, Compare, Augment, Trace>::Insert(T value) {
+  trace_.Record(TraceEvent::kInsert, nullptr);
   if (root_ == nullptr) {
     root_ = new Node();
     root_->keys.push_back(value);
     root_->children = {nullptr, nullptr};
   }
-  Node *cur = root_, *tmp = nullptr;
+  if constexpr (!Augment::kEnabled) {
+    if (finger_ != nullptr && int(finger_->keys.size()) < 2 * factor - 1 &&
+        (!finger_low_ || less_(*finger_low_, value)) && (!finger_high_ || less_(value, *finger_high_))) {
+      trace_.Record(TraceEvent::kVisit, finger_);
+      auto iter = std::lower_bound(finger_->keys.begin(), finger_->keys.end(), value, less_);
+      if (iter == finger_->keys.end() || less_(value, *iter)) {
+        InsertInner(finger_, value);
+      }
+      return;
+    }
+  }
+  finger_ = nullptr;
+  finger_low_.reset(), finger_high_.reset();
+  Node *cur = Own(root_), *tmp = nullptr;
   while (cur != nullptr) {
     cur = FixOversaturation(cur, tmp);
+    AddToPath(cur);
     tmp = cur;
-    if (!Follow(cur, value)) {
+    // A node split on the way is followed again, with tighter separators.
+    int position;
+    if (!Follow(cur, value, &position)) {
+      finger_low_.reset(), finger_high_.reset();
+      UpdatePath();
       return;
     }
+    cur = Own(tmp->children[position]);
+    if (position > 0) {
+      finger_low_ = tmp->keys[position - 1];
+    }
+    if (position < int(tmp->keys.size())) {
+      finger_high_ = tmp->keys[position];
+    }
   }
   cur = tmp;
   InsertInner(cur, value);
+  finger_ = cur;
+  UpdatePath();
 }
 
-template <typename T>
-void BTree<T>::Erase(T value) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+void BTree<T, Compare, Augment, Trace>::Erase(T value) {
+  trace_.Record(TraceEvent::kErase, nullptr);
+  finger_ = nullptr;
   if (root_ == nullptr) {
     return;
   }
-  Node *cur = root_, *tmp = nullptr;
+  Node *cur = Own(root_), *tmp = nullptr;
   while (cur != nullptr) {
     cur = FixUndersaturation(cur, tmp);
+    AddToPath(cur);
     tmp = cur;
     if (cur->IsLeaf()) {
       EraseInner(cur, value);
+      UpdatePath();
       return;
     }
-    if (!Follow(cur, value)) {
+    int position;
+    if (Follow(cur, value, &position)) {
+      cur = Own(tmp->children[position]);
+    } else {
       // Find the needed iterator and the right child
-      auto iter = std::lower_bound(cur->keys.begin(), cur->keys.end(), value);
+      auto iter = std::lower_bound(cur->keys.begin(), cur->keys.end(), value, less_);
       int pos = std::distance(cur->keys.begin(), iter);
-      Node *right_ch = cur->children[pos + 1];
+      Node *right_ch = Own(cur->children[pos + 1]);
       assert(right_ch != nullptr);
 
-      // Swap with the minimum from the right child
+      // Swap with the minimum from the right child, owning the way there
       Node *min_node = right_ch;
       while (!min_node->IsLeaf()) {
-        min_node = min_node->children.front();
+        min_node = Own(min_node->children.front());
       }
       T last_min = min_node->keys.front();
       std::swap(cur->keys[pos], min_node->keys.front());
@@ -72,18 +207,22 @@ void BTree<T>::Erase(T value) {
         Node *where = right_ch;
         Follow(where, last_min);
         right_ch = FixUndersaturation(right_ch, tmp);
+        AddToPath(right_ch);
         tmp = right_ch;
         right_ch = where;
       }
       right_ch = FixUndersaturation(right_ch, tmp);
+      AddToPath(right_ch);
       EraseInner(right_ch, value);
+      UpdatePath();
       return;
     }
   }
 }
 
-template <typename T>
-bool BTree<T>::Find(T value) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+bool BTree<T, Compare, Augment, Trace>::Find(T value) {
+  trace_.Record(TraceEvent::kFind, nullptr);
   if (root_ == nullptr) {
     return false;
   }
@@ -98,18 +237,53 @@ bool BTree<T>::Find(T value) {
   return false;
 }
 
-template <typename T>
-void BTree<T>::InsertInner(Node *node, T value) {
-  auto iter = std::lower_bound(node->keys.begin(), node->keys.end(), value);
+template <typename T, typename Compare, typename Augment, typename Trace>
+size_t BTree<T, Compare, Augment, Trace>::FindBatch(std::span<const T> keys, std::span<uint8_t> results) {
+  if constexpr (Trace::kEnabled) {
+    // One by one, so that the events of every lookup stay together.
+    return BatchOperations<BTree, T>::FindBatch(keys, results);
+  } else {
+    // A node takes two steps: its arrays are separate allocations, so they
+    // are prefetched once the node itself has arrived.
+    struct Cursor {
+      Node *node;
+      bool arrived;
+    };
+    return InterleaveLookups(keys, results, Cursor{root_, false}, [this](Cursor &cursor, const T &key) {
+      using Step = std::pair<BatchStep, const void*>;
+      if (cursor.node == nullptr) {
+        return Step(BatchStep::kMissing, nullptr);
+      }
+      if (!cursor.arrived) {
+        cursor.arrived = true;
+        Prefetch(cursor.node->children.data());
+        return Step(BatchStep::kPending, cursor.node->keys.data());
+      }
+      auto iter = std::lower_bound(cursor.node->keys.begin(), cursor.node->keys.end(), key, less_);
+      if (iter != cursor.node->keys.end() && !less_(key, *iter)) {
+        return Step(BatchStep::kFound, nullptr);
+      }
+      cursor = {cursor.node->children[iter - cursor.node->keys.begin()], false};
+      return Step(BatchStep::kPending, cursor.node);
+    });
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void BTree<T, Compare, Augment, Trace>::InsertInner(Node *node, T value) {
+  auto iter = std::lower_bound(node->keys.begin(), node->keys.end(), value, less_);
   int pos = std::distance(node->keys.begin(), iter);
   node->keys.insert(iter, value);
   node->children.insert(node->children.begin() + pos, nullptr);
 }
 
-template <typename T>
-void BTree<T>::EraseInner(Node *node, T value) {
-  auto iter = std::find(node->keys.begin(), node->keys.end(), value);
-  if (iter == node->keys.end() || *iter != value) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+void BTree<T, Compare, Augment, Trace>::EraseInner(Node *node, T value) {
+  // Linear: after the swap in Erase the key may be out of order here.
+  auto iter = std::find_if(node->keys.begin(), node->keys.end(), [&](const T &key) {
+    return !less_(key, value) && !less_(value, key);
+  });
+  if (iter == node->keys.end()) {
     return;
   }
   int pos = std::distance(node->keys.begin(), iter);
@@ -118,20 +292,23 @@ void BTree<T>::EraseInner(Node *node, T value) {
   if (node->keys.size() == 0) {
     delete node;
     root_ = nullptr;
+    path_.clear();
   }
 }
 
-template <typename T>
-BTree<T>::Node* BTree<T>::FixOversaturation(Node *node, Node *par) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+BTree<T, Compare, Augment, Trace>::Node* BTree<T, Compare, Augment, Trace>::FixOversaturation(Node *node, Node *par) {
   if (int(node->keys.size()) < 2 * factor - 1) {
     return node;
   }
   T med = node->keys[factor - 1];
   Node *brother = new Node();
+  trace_.Record(TraceEvent::kSplit, brother, node);
   brother->children = std::vector<Node*>(node->children.begin() + factor, node->children.end());
   node->children.resize(factor);
   brother->keys = std::vector<T>(node->keys.begin() + factor, node->keys.end());
   node->keys.resize(factor - 1);
+  UpdateAugment(node), UpdateAugment(brother);
   if (par == nullptr) {
     root_ = new Node();
     root_->keys = {med};
@@ -147,8 +324,8 @@ BTree<T>::Node* BTree<T>::FixOversaturation(Node *node, Node *par) {
   }
 }
 
-template <typename T>
-BTree<T>::Node* BTree<T>::FixUndersaturation(Node *node, Node *par) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+BTree<T, Compare, Augment, Trace>::Node* BTree<T, Compare, Augment, Trace>::FixUndersaturation(Node *node, Node *par) {
   if (int(node->keys.size()) > factor - 1 || par == nullptr) {
     return node;
   }
@@ -156,32 +333,39 @@ BTree<T>::Node* BTree<T>::FixUndersaturation(Node *node, Node *par) {
   int pos = std::distance(par->children.begin(), iter);
   if (pos + 1 < int(par->children.size())) {
     if (int(par->children[pos + 1]->keys.size()) >= factor) {
-      int x = par->keys[pos];
+      Own(par->children[pos + 1]);
+      trace_.Record(TraceEvent::kBorrow, node, par->children[pos + 1]);
+      T x = par->keys[pos];
       par->children[pos]->keys.push_back(x);
       par->children[pos]->children.push_back(par->children[pos + 1]->children.front());
       par->keys[pos] = par->children[pos + 1]->keys.front();
       par->children[pos + 1]->keys.erase(par->children[pos + 1]->keys.begin());
       par->children[pos + 1]->children.erase(par->children[pos + 1]->children.begin());
+      UpdateAugment(par->children[pos + 1]);
       return node;
     }
   }
   if (pos - 1 >= 0) {
     if (int(par->children[pos - 1]->keys.size()) >= factor) {
-      int x = par->keys[pos - 1];
+      Own(par->children[pos - 1]);
+      trace_.Record(TraceEvent::kBorrow, node, par->children[pos - 1]);
+      T x = par->keys[pos - 1];
       par->children[pos]->keys.insert(par->children[pos]->keys.begin(), x);
       par->children[pos]->children.insert(par->children[pos]->children.begin(),
                                           par->children[pos - 1]->children.back());
       par->keys[pos - 1] = par->children[pos - 1]->keys.back();
       par->children[pos - 1]->keys.pop_back();
       par->children[pos - 1]->children.pop_back();
+      UpdateAugment(par->children[pos - 1]);
       return node;
     }
   }
   if (pos + 1 == int(par->children.size())) {
     --pos;
   }
-  node = par->children[pos];
-  Node *nxt = par->children[pos + 1];
+  node = Own(par->children[pos]);
+  Node *nxt = Own(par->children[pos + 1]);
+  trace_.Record(TraceEvent::kMerge, node, nxt);
   node->children.insert(node->children.end(), nxt->children.begin(), nxt->children.end());
   node->keys.push_back(par->keys[pos]);
   node->keys.insert(node->keys.end(), nxt->keys.begin(), nxt->keys.end());
@@ -191,6 +375,9 @@ BTree<T>::Node* BTree<T>::FixUndersaturation(Node *node, Node *par) {
   delete nxt;
   if (par->keys.empty()) {
     assert(par == root_);
+    if (!path_.empty() && path_.back() == par) {
+      path_.pop_back();
+    }
     delete par;
     root_ = node;
     return node;
@@ -199,29 +386,156 @@ BTree<T>::Node* BTree<T>::FixUndersaturation(Node *node, Node *par) {
   }
 }
 
-template <typename T>
-VisualizationData* BTree<T>::GetVisualizationData() {
-  auto DFS = [&](auto&& self, Node *node) -> VisualizationData* {
-    if (node == nullptr) {
-      return nullptr;
-    }
-    VisualizationData *data = new VisualizationData();
+template <typename T, typename Compare, typename Augment, typename Trace>
+void BTree<T, Compare, Augment, Trace>::GetVisualizationData(VisualizationData<T> &data) {
+  Visualize(root_, selected_, data);
+  selected_ = nullptr;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void BTree<T, Compare, Augment, Trace>::Visualize(Node *root, Node *selected, VisualizationData<T> &data) {
+  data.Clear();
+  // Preorder with an explicit stack: node, index of its parent, child slot.
+  std::vector<std::tuple<Node*, int, int>> stack;
+  if (root != nullptr) {
+    stack.emplace_back(root, -1, 0);
+  }
+  while (!stack.empty()) {
+    auto [node, parent, slot] = stack.back();
+    stack.pop_back();
+    int index = data.AddNode(reinterpret_cast<uintptr_t>(node), node->children.size());
     for (auto key : node->keys) {
-      data->keys.push_back(std::to_string(key));
-      if (node == selected_) {
-        data->colors.push_back({QColor(Qt::green), QColor(Qt::white)});
-      } else {
-        data->colors.push_back({QColor("#CDCDCE"), QColor(Qt::black)});
+      data.AddKey(key, VisualizationData<T>::kPlain, node == selected);
+    }
+    if (parent != -1) {
+      data.SetChild(parent, slot, index);
+    }
+    for (int i = int(node->children.size()) - 1; i >= 0; i--) {
+      if (node->children[i] != nullptr) {
+        stack.emplace_back(node->children[i], index, i);
       }
     }
-    for (auto child : node->children) {
-      data->children.push_back(self(self, child));
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+const TraceRecorder* BTree<T, Compare, Augment, Trace>::GetTrace() const {
+  if constexpr (std::is_same_v<Trace, TraceRecorder>) {
+    return &trace_;
+  } else {
+    return nullptr;
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+const Trace& BTree<T, Compare, Augment, Trace>::GetTracePolicy() const {
+  return trace_;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+TreeStats BTree<T, Compare, Augment, Trace>::GetStats() const {
+  return Stats(root_);
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+TreeStats BTree<T, Compare, Augment, Trace>::Stats(Node *root) {
+  TreeStats stats;
+  std::vector<std::pair<Node*, int>> stack;
+  if (root != nullptr) {
+    stack.emplace_back(root, 1);
+  }
+  while (!stack.empty()) {
+    auto [node, depth] = stack.back();
+    stack.pop_back();
+    stats.keys += node->keys.size();
+    stats.nodes++;
+    stats.bytes += sizeof(Node) + node->keys.capacity() * sizeof(T) + node->children.capacity() * sizeof(Node*);
+    stats.height = std::max(stats.height, depth);
+    for (Node *child : node->children) {
+      if (child != nullptr) {
+        stack.emplace_back(child, depth + 1);
+      }
     }
-    return data;
-  };
-  VisualizationData* data = DFS(DFS, root_);
-  selected_ = nullptr;
-  return data;
+  }
+  return stats;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+BTree<T, Compare, Augment, Trace>::AugmentData BTree<T, Compare, Augment, Trace>::GetAugment() const {
+  return root_ != nullptr ? root_->augment : AugmentData();
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+BTree<T, Compare, Augment, Trace>::Snapshot::Snapshot(Node *root) : root_(root) {}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+BTree<T, Compare, Augment, Trace>::Snapshot::Snapshot(Snapshot &&other) : root_(std::exchange(other.root_, nullptr)) {}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+BTree<T, Compare, Augment, Trace>::Snapshot& BTree<T, Compare, Augment, Trace>::Snapshot::operator=(Snapshot &&other) {
+  if (this != &other) {
+    Release(root_);
+    root_ = std::exchange(other.root_, nullptr);
+  }
+  return *this;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+BTree<T, Compare, Augment, Trace>::Snapshot::~Snapshot() {
+  Release(root_);
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+bool BTree<T, Compare, Augment, Trace>::Snapshot::Find(T value) const {
+  Node *cur = root_;
+  while (cur != nullptr) {
+    auto iter = std::lower_bound(cur->keys.begin(), cur->keys.end(), value, less_);
+    if (iter != cur->keys.end() && !less_(value, *iter)) {
+      return true;
+    }
+    cur = cur->children[iter - cur->keys.begin()];
+  }
+  return false;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+template <typename Visit>
+void BTree<T, Compare, Augment, Trace>::Snapshot::ForEach(Visit visit) const {
+  // Inorder with an explicit stack: node and the next key to visit.
+  std::vector<std::pair<Node*, size_t>> stack;
+  if (root_ != nullptr) {
+    stack.emplace_back(root_, 0);
+  }
+  while (!stack.empty()) {
+    auto &[node, next] = stack.back();
+    if (next > node->keys.size()) {
+      stack.pop_back();
+      continue;
+    }
+    Node *child = node->children[next];
+    if (next > 0) {
+      visit(node->keys[next - 1]);
+    }
+    next++;
+    if (child != nullptr) {
+      stack.emplace_back(child, 0);
+    }
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void BTree<T, Compare, Augment, Trace>::Snapshot::GetVisualizationData(VisualizationData<T> &data) const {
+  Visualize(root_, nullptr, data);
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+TreeStats BTree<T, Compare, Augment, Trace>::Snapshot::GetStats() const {
+  return Stats(root_);
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+BTree<T, Compare, Augment, Trace>::AugmentData BTree<T, Compare, Augment, Trace>::Snapshot::GetAugment() const {
+  return root_ != nullptr ? root_->augment : AugmentData();
 }
 
 #endif // BTREE_IMPL
@@ -1,39 +1,135 @@
 #ifndef BTREE_H
 #define BTREE_H
 
-#include "Visualization.h"
+#include "TreeEngine.h"
+#include <atomic>
+#include <optional>
 #include <vector>
 
-template <typename T>
-class BTree : public VisualizableTree<T> {
+// Nodes are reference counted and copied on write, so that TakeSnapshot is
+// O(1) and a change copies only the nodes it touches that a snapshot still
+// shares.
+// Augment: see TreeEngine.h; Trace: see OperationTrace.h.
+template <typename T, typename Compare = std::less<T>, typename Augment = NoAugment, typename Trace = NoTrace>
+class BTree : public BatchOperations<BTree<T, Compare, Augment, Trace>, T> {
+  struct Node;
+
  public:
+  using KeyType = T;
+  using AugmentData = typename Augment::Data;
+
+  // The keys of the tree when it was taken. A snapshot only reads, so any
+  // number of threads may use it, and drop it, while the tree changes.
+  class Snapshot {
+    friend class BTree;
+   public:
+    Snapshot() = default;
+
+    Snapshot(Snapshot &&other);
+    Snapshot& operator=(Snapshot &&other);
+
+    ~Snapshot();
+
+    bool Find(T value) const;
+
+    // Calls visit(key) on every key in order.
+    template <typename Visit>
+    void ForEach(Visit visit) const;
+
+    void GetVisualizationData(VisualizationData<T> &data) const;
+
+    TreeStats GetStats() const;
+
+    AugmentData GetAugment() const;
+
+   private:
+    Node *root_ = nullptr;
+    [[no_unique_address]] Compare less_;
+
+    explicit Snapshot(Node *root);
+  };
+
   int factor;
 
   BTree() : factor(2) {}
 
   BTree(int factor_) : factor(factor_) {}
 
-  void Insert(T value) override;
+  BTree(const BTree&) = delete;
+  BTree& operator=(const BTree&) = delete;
+
+  ~BTree();
 
-  void Erase(T value) override;
+  // A key that falls into the leaf of the last insertion (sorted runs) goes
+  // there without a descent while the leaf has room, unless Augment needs
+  // the path updated.
+  void Insert(T value);
 
-  bool Find(T value) override;
+  void Erase(T value);
 
-  VisualizationData* GetVisualizationData() override;
+  bool Find(T value);
+
+  // Interleaves the lookups unless the engine records a trace.
+  size_t FindBatch(std::span<const T> keys, std::span<uint8_t> results);
+
+  void GetVisualizationData(VisualizationData<T> &data);
+
+  const TraceRecorder* GetTrace() const;
+
+  const Trace& GetTracePolicy() const;
+
+  TreeStats GetStats() const;
+
+  // Augment data of the whole tree.
+  AugmentData GetAugment() const;
+
+  // O(1); the finger is reset, since its leaf becomes shared.
+  Snapshot TakeSnapshot();
 
  private: 
   struct Node {
     std::vector<T> keys;
     std::vector<Node*> children;
+    [[no_unique_address]] AugmentData augment;
+    // Parents and roots pointing here: the tree's and the snapshots'.
+    std::atomic<int> refs = 1;
 
     bool IsLeaf();
   
-    friend bool BTree<T>::Follow(Node *&node, T key);
+    friend bool BTree<T, Compare, Augment, Trace>::Follow(Node *&node, T key, int *position);
   };
 
   Node *root_ = nullptr, *selected_ = nullptr;
+  [[no_unique_address]] Compare less_;
+  [[no_unique_address]] Trace trace_;
+  // Nodes on the path of the current operation, parents first; their
+  // augment data is updated bottom-up when it ends.
+  std::vector<Node*> path_;
+  std::vector<const AugmentData*> child_augments_;
+  // Leaf of the last insertion and the separators around it, none past the
+  // ends. Every descent and erase resets it, since they split and merge.
+  Node *finger_ = nullptr;
+  std::optional<T> finger_low_, finger_high_;
+
+  // Sets position to the index of the child followed.
+  bool Follow(Node *&node, T key, int *position = nullptr);
+
+  // Makes the node in slot, a child of a node already owned or root_, this
+  // tree's alone, copying it if shared. Returns it; nullptr stays.
+  Node* Own(Node *&slot);
+
+  // Drops a reference, freeing the nodes no longer referenced.
+  static void Release(Node *node);
+
+  static void Visualize(Node *root, Node *selected, VisualizationData<T> &data);
+
+  static TreeStats Stats(Node *root);
+
+  void UpdateAugment(Node *node);
+
+  void AddToPath(Node *node);
 
-  bool Follow(Node *&node, T key);
+  void UpdatePath();
 
   void InsertInner(Node *node, T key);
 
@@ -0,0 +1,210 @@
+#ifndef BUFFERPOOL_IMPL
+#define BUFFERPOOL_IMPL
+
+#include "BufferPool.h"
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+
+inline BufferPool::BufferPool(const std::string &path, size_t page_size, size_t frames)
+    : page_size_(page_size), memory_(nullptr, std::free) {
+  frames = std::max<size_t>(frames, 8);
+  fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  // Scratch storage: the name goes at once, so that pools may share a path
+  // and nothing is left behind by a crash.
+  if (fd_ == -1) {
+    Fail(("cannot open " + path).c_str());
+  } else {
+    unlink(path.c_str());
+  }
+  memory_.reset(static_cast<std::byte*>(std::aligned_alloc(page_size, frames * page_size)));
+  if (memory_ == nullptr) {
+    Fail("cannot allocate the frames");
+    frames = 0;
+  }
+  frames_.resize(frames);
+}
+
+inline BufferPool::~BufferPool() {
+  // Nothing is written back.
+  if (fd_ != -1) {
+    close(fd_);
+  }
+}
+
+inline bool BufferPool::IsOpen() const {
+  return fd_ != -1;
+}
+
+inline bool BufferPool::Failed() const {
+  return failed_;
+}
+
+inline size_t BufferPool::PageSize() const {
+  return page_size_;
+}
+
+inline size_t BufferPool::FrameCount() const {
+  return frames_.size();
+}
+
+inline uint32_t BufferPool::PageCount() const {
+  return frame_of_.size();
+}
+
+inline std::byte* BufferPool::FrameData(size_t frame) {
+  return memory_.get() + frame * page_size_;
+}
+
+inline uint32_t BufferPool::Allocate() {
+  uint32_t page;
+  if (!free_pages_.empty()) {
+    page = free_pages_.back();
+    free_pages_.pop_back();
+  } else {
+    page = frame_of_.size();
+    frame_of_.push_back(-1);
+  }
+  // Not read: the page starts zeroed and dirty.
+  int32_t frame = frame_of_[page];
+  if (frame == -1) {
+    frame = Victim();
+    frames_[frame].page = page;
+    frame_of_[page] = frame;
+  }
+  std::memset(FrameData(frame), 0, page_size_);
+  frames_[frame].dirty = frames_[frame].referenced = true;
+  return page;
+}
+
+inline void BufferPool::Release(uint32_t page) {
+  // The frame stays mapped, the next Allocate of the page zeroes it.
+  if (int32_t frame = frame_of_[page]; frame != -1) {
+    assert(frames_[frame].pins == 0);
+    frames_[frame].dirty = false;
+  }
+  free_pages_.push_back(page);
+}
+
+inline void BufferPool::Fail(const char *what) {
+  if (!failed_) {
+    std::cerr << "BufferPool: " << what << ": " << std::strerror(errno) << '\n';
+  }
+  failed_ = true;
+}
+
+inline std::byte* BufferPool::Pin(uint32_t page) {
+  int32_t frame = frame_of_[page];
+  if (frame != -1) {
+    stats_.hits++;
+  } else {
+    stats_.misses++;
+    frame = Victim();
+    std::memset(FrameData(frame), 0, page_size_);
+    if (!failed_) {
+      stats_.reads++;
+      if (pread(fd_, FrameData(frame), page_size_, off_t(page) * page_size_) != ssize_t(page_size_)) {
+        std::memset(FrameData(frame), 0, page_size_);
+        Fail("cannot read a page");
+      }
+    }
+    frames_[frame].page = page;
+    frame_of_[page] = frame;
+  }
+  frames_[frame].pins++;
+  frames_[frame].referenced = true;
+  return FrameData(frame);
+}
+
+inline void BufferPool::Unpin(uint32_t page, bool dirty) {
+  Frame &frame = frames_[frame_of_[page]];
+  assert(frame.pins > 0);
+  frame.pins--;
+  frame.dirty |= dirty;
+}
+
+inline size_t BufferPool::Victim() {
+  // Every frame pinned means a caller pins more pages than it should, the
+  // B-Tree holds a handful at most. Reusing a pinned frame would overwrite a
+  // page in use, so this stops the program.
+  for (size_t step = 0; step < 2 * frames_.size() + 1; step++) {
+    size_t frame = hand_;
+    hand_ = (hand_ + 1) % frames_.size();
+    if (frames_[frame].pins > 0) {
+      continue;
+    }
+    if (frames_[frame].referenced) {
+      frames_[frame].referenced = false;
+      continue;
+    }
+    if (frames_[frame].page != kNoPage) {
+      WriteBack(frame);
+      frame_of_[frames_[frame].page] = -1;
+      frames_[frame].page = kNoPage;
+    }
+    return frame;
+  }
+  std::cerr << "BufferPool: all " << frames_.size() << " frames are pinned\n";
+  std::abort();
+}
+
+inline void BufferPool::WriteBack(size_t frame) {
+  if (frames_[frame].dirty && !failed_) {
+    stats_.writes++;
+    if (pwrite(fd_, FrameData(frame), page_size_, off_t(frames_[frame].page) * page_size_) != ssize_t(page_size_)) {
+      Fail("cannot write a page");
+    }
+  }
+  frames_[frame].dirty = false;
+}
+
+inline void BufferPool::Flush() {
+  for (size_t frame = 0; frame < frames_.size(); frame++) {
+    if (frames_[frame].page != kNoPage) {
+      WriteBack(frame);
+    }
+  }
+}
+
+inline void BufferPool::DropCaches() {
+  for (size_t frame = 0; frame < frames_.size(); frame++) {
+    if (frames_[frame].page != kNoPage && frames_[frame].pins == 0) {
+      WriteBack(frame);
+      frame_of_[frames_[frame].page] = -1;
+      frames_[frame] = Frame();
+    }
+  }
+  // Written pages are only dropped once they reach the disk.
+  if (failed_) {
+    return;
+  }
+  fdatasync(fd_);
+#ifdef POSIX_FADV_DONTNEED
+  posix_fadvise(fd_, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+}
+
+inline bool BufferPool::SetDirect(bool direct) {
+#ifdef O_DIRECT
+  // The frames and offsets are aligned to the page size, as O_DIRECT needs.
+  int flags = fcntl(fd_, F_GETFL);
+  return flags != -1 && fcntl(fd_, F_SETFL, direct ? flags | O_DIRECT : flags & ~O_DIRECT) == 0;
+#else
+  return false;
+#endif
+}
+
+inline const BufferPool::Stats& BufferPool::GetStats() const {
+  return stats_;
+}
+
+inline void BufferPool::ResetStats() {
+  stats_ = Stats();
+}
+
+#endif // BUFFERPOOL_IMPL
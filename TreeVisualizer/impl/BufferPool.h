@@ -0,0 +1,101 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Fixed-size pages of a scratch file, cached in a fixed number of frames
+// replaced by the CLOCK policy. Pinned frames stay put; dirty ones are
+// written back when they are replaced or flushed. The file belongs to the
+// pool and lives as long as it. POSIX file I/O.
+//
+// An I/O error is reported on stderr and sets Failed(). From then on the
+// pool does no I/O and every page it reads comes back zeroed, so its user
+// must check Failed() after pinning and stop.
+class BufferPool {
+ public:
+  struct Stats {
+    uint64_t hits = 0, misses = 0, reads = 0, writes = 0;
+  };
+
+  static constexpr uint32_t kNoPage = UINT32_MAX;
+
+  // Creates or truncates the file at path; frames is raised to a handful so
+  // that a few pages can be pinned at once.
+  BufferPool(const std::string &path, size_t page_size, size_t frames);
+
+  ~BufferPool();
+
+  BufferPool(const BufferPool&) = delete;
+  BufferPool& operator=(const BufferPool&) = delete;
+
+  bool IsOpen() const;
+
+  bool Failed() const;
+
+  size_t PageSize() const;
+
+  size_t FrameCount() const;
+
+  // Pages in the file, free ones included.
+  uint32_t PageCount() const;
+
+  // A zeroed page, reusing released ones first.
+  uint32_t Allocate();
+
+  void Release(uint32_t page);
+
+  // The bytes of page, which stays in its frame until unpinned as many times.
+  std::byte* Pin(uint32_t page);
+
+  void Unpin(uint32_t page, bool dirty);
+
+  // Writes back every dirty frame.
+  void Flush();
+
+  // Flushes, empties the frames and asks the OS to drop the file from its
+  // cache, so that the next accesses go to the disk.
+  void DropCaches();
+
+  // While set, pages are read and written past the OS cache, straight to
+  // the disk. False if the file system does not support it.
+  bool SetDirect(bool direct);
+
+  const Stats& GetStats() const;
+
+  void ResetStats();
+
+ private:
+  struct Frame {
+    uint32_t page = kNoPage;
+    int pins = 0;
+    bool dirty = false, referenced = false;
+  };
+
+  int fd_ = -1;
+  size_t page_size_;
+  bool failed_ = false;
+  // Aligned to the page size, frame i at i * page_size_.
+  std::unique_ptr<std::byte, void (*)(void*)> memory_;
+  std::vector<Frame> frames_;
+  // Frame of every page, -1 if not cached.
+  std::vector<int32_t> frame_of_;
+  std::vector<uint32_t> free_pages_;
+  size_t hand_ = 0;
+  Stats stats_;
+
+  std::byte* FrameData(size_t frame);
+
+  // Reports the first failure with errno.
+  void Fail(const char *what);
+
+  // A frame to reuse, written back and unmapped.
+  size_t Victim();
+
+  void WriteBack(size_t frame);
+};
+
+#endif // BUFFERPOOL_H
@@ -0,0 +1,229 @@
+#ifndef COMPARISON_IMPL
+#define COMPARISON_IMPL
+
+#include <QHBoxLayout>
+#include <QVBoxLayout>
+#include <QGridLayout>
+#include <QLabel>
+#include <QGraphicsScene>
+#include <chrono>
+#include <random>
+#include "Comparison.h"
+#include "AVLTree.h"
+#include "RBTree.h"
+#include "SplayTree.h"
+#include "BTree.h"
+#include "Treap.h"
+#include "ScapegoatTree.h"
+#include "VebTree.h"
+#include "ArtTree.h"
+
+enum ComparisonColumn {
+  kOpsColumn,
+  kThroughputColumn,
+  kHeightColumn,
+  kNodesColumn,
+  kMemoryColumn,
+  kRotationsColumn,
+  kRestructuresColumn,
+  kColumnCount
+};
+
+inline ComparisonDialog::ComparisonDialog(int factor, Reclaimer *reclaimer, QWidget *parent)
+    : QDialog(parent), factor_(factor), reclaimer_(reclaimer) {
+  setWindowTitle("Compare engines");
+  workload_ = new QComboBox();
+  workload_->addItem("Random inserts");
+  workload_->addItem("Sequential inserts");
+  workload_->addItem("Mixed finds, inserts and erases");
+  count_ = new QSpinBox();
+  count_->setRange(1, 100000000);
+  count_->setSingleStep(100000);
+  count_->setValue(1000000);
+  start_ = new QPushButton("Start");
+  QHBoxLayout *controls = new QHBoxLayout();
+  controls->addWidget(new QLabel("Workload:"));
+  controls->addWidget(workload_);
+  controls->addWidget(new QLabel("Operations:"));
+  controls->addWidget(count_);
+  controls->addWidget(start_);
+  controls->addStretch();
+
+  QStringList names = {"AVL Tree", "RB Tree", "Splay Tree", "B-Tree", "Treap", "Scapegoat Tree", "vEB Tree", "ART"};
+  table_ = new QTableWidget(names.size(), kColumnCount);
+  table_->setHorizontalHeaderLabels({"Ops", "Throughput", "Height", "Nodes", "Memory", "Rotations",
+                                     "Restructures"});
+  table_->setVerticalHeaderLabels(names);
+  table_->setEditTriggers(QTableWidget::NoEditTriggers);
+  QGridLayout *renders = new QGridLayout();
+  for (int i = 0; i < int(names.size()); i++) {
+    auto lane = std::make_unique<Lane>();
+    lane->name = names[i];
+    lane->view = new QGraphicsView();
+    lane->view->setScene(new QGraphicsScene(lane->view));
+    lane->view->setInteractive(false);
+    lane->view->setMinimumSize(200, 150);
+    renders->addWidget(new QLabel(names[i]), 2 * (i / 3), i % 3);
+    renders->addWidget(lane->view, 2 * (i / 3) + 1, i % 3);
+    for (int column = 0; column < kColumnCount; column++) {
+      table_->setItem(i, column, new QTableWidgetItem());
+    }
+    lanes_.push_back(std::move(lane));
+  }
+  QHBoxLayout *body = new QHBoxLayout();
+  body->addWidget(table_);
+  body->addLayout(renders);
+  QVBoxLayout *layout = new QVBoxLayout(this);
+  layout->addLayout(controls);
+  layout->addLayout(body);
+  resize(1200, 600);
+
+  timer_ = new QTimer(this);
+  connect(timer_, &QTimer::timeout, this, [this] {
+    Refresh();
+  });
+  connect(start_, &QPushButton::clicked, this, [this] {
+    Start();
+  });
+}
+
+inline ComparisonDialog::~ComparisonDialog() {
+  Stop();
+}
+
+template <typename Engine>
+void ComparisonDialog::StartLane(Lane &lane, TreeAdapter<Engine> *adapter, Workload workload, int count,
+                                 KeyPermutation keys) {
+  lane.tree = adapter;
+  Engine *tree = &adapter->engine;
+  lane.thread = QThread::create([this, &lane, tree, workload, count, keys] {
+    constexpr int kProgressStep = 1 << 12;
+    // The same seed in every lane, so that all engines see the same stream.
+    std::mt19937_64 rng(keys(0));
+    uint32_t inserted = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto Publish = [&](int done) {
+      const auto &counter = tree->GetTracePolicy();
+      lane.done.store(done, std::memory_order_relaxed);
+      lane.nanoseconds.store(std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+      lane.rotations.store(counter.Count(TraceEvent::kRotateLeft) + counter.Count(TraceEvent::kRotateRight),
+                           std::memory_order_relaxed);
+      lane.restructures.store(counter.Count(TraceEvent::kSplit) + counter.Count(TraceEvent::kMerge) +
+                              counter.Count(TraceEvent::kBorrow) + counter.Count(TraceEvent::kRebuild),
+                              std::memory_order_relaxed);
+    };
+    for (int i = 0; i < count; i++) {
+      if (workload == kSequentialInserts) {
+        tree->Insert(i + 1);
+      } else if (workload == kRandomInserts) {
+        tree->Insert(keys(i));
+      } else {
+        uint64_t draw = rng();
+        uint32_t earlier = (draw >> 2) % (inserted + 1);
+        if ((draw & 3) < 2) {
+          tree->Find(keys(earlier));
+        } else if ((draw & 3) == 2) {
+          tree->Insert(keys(inserted++));
+        } else {
+          tree->Erase(keys(earlier));
+        }
+      }
+      if ((i + 1) % kProgressStep == 0) {
+        Publish(i + 1);
+        if (cancel_.load(std::memory_order_relaxed)) {
+          return;
+        }
+      }
+    }
+    Publish(count);
+    lane.stats = tree->GetStats();
+    lane.finished.store(true, std::memory_order_release);
+  });
+  lane.thread->start();
+}
+
+inline void ComparisonDialog::Start() {
+  Stop();
+  Workload workload = Workload(workload_->currentIndex());
+  int count = count_->value();
+  // A fresh seed per run, shared by the lanes.
+  KeyPermutation keys;
+  StartLane(*lanes_[0], new TreeAdapter<TracedEngine<AVLTree, int, TraceCounter>>(), workload, count, keys);
+  StartLane(*lanes_[1], new TreeAdapter<TracedEngine<RBTree, int, TraceCounter>>(), workload, count, keys);
+  StartLane(*lanes_[2], new TreeAdapter<TracedEngine<SplayTree, int, TraceCounter>>(), workload, count, keys);
+  StartLane(*lanes_[3], new TreeAdapter<TracedEngine<BTree, int, TraceCounter>>(factor_), workload, count, keys);
+  StartLane(*lanes_[4], new TreeAdapter<TracedEngine<Treap, int, TraceCounter>>(), workload, count, keys);
+  StartLane(*lanes_[5], new TreeAdapter<TracedEngine<ScapegoatTree, int, TraceCounter>>(), workload, count, keys);
+  StartLane(*lanes_[6], new TreeAdapter<TracedEngine<VebTree, int, TraceCounter>>(), workload, count, keys);
+  StartLane(*lanes_[7], new TreeAdapter<TracedEngine<ArtTree, int, TraceCounter>>(), workload, count, keys);
+  timer_->start(200);
+}
+
+inline void ComparisonDialog::Stop() {
+  timer_->stop();
+  cancel_ = true;
+  for (auto &lane : lanes_) {
+    if (lane->thread != nullptr) {
+      lane->thread->wait();
+      delete lane->thread;
+      lane->thread = nullptr;
+    }
+    if (lane->updater != nullptr) {
+      reclaimer_->Discard(lane->updater->ReleaseItem());
+      delete lane->updater;
+      lane->updater = nullptr;
+    }
+    reclaimer_->Discard(lane->tree);
+    lane->tree = nullptr;
+    lane->done = lane->nanoseconds = lane->rotations = lane->restructures = 0;
+    lane->finished = false;
+    lane->stats = TreeStats();
+  }
+  cancel_ = false;
+}
+
+inline void ComparisonDialog::Refresh() {
+  bool running = false;
+  for (int row = 0; row < int(lanes_.size()); row++) {
+    Lane &lane = *lanes_[row];
+    if (lane.tree == nullptr) {
+      continue;
+    }
+    bool finished = lane.finished.load(std::memory_order_acquire);
+    uint64_t done = lane.done.load(std::memory_order_relaxed);
+    double seconds = lane.nanoseconds.load(std::memory_order_relaxed) / 1e9;
+    table_->item(row, kOpsColumn)->setText(QString::number(done));
+    table_->item(row, kThroughputColumn)->setText(
+        seconds > 0 ? QString::number(done / seconds / 1e6, 'f', 2) + " M/s" : QString("-"));
+    table_->item(row, kRotationsColumn)->setText(QString::number(lane.rotations.load(std::memory_order_relaxed)));
+    table_->item(row, kRestructuresColumn)->setText(
+        QString::number(lane.restructures.load(std::memory_order_relaxed)));
+    if (finished && lane.updater == nullptr) {
+      table_->item(row, kHeightColumn)->setText(QString::number(lane.stats.height));
+      table_->item(row, kNodesColumn)->setText(QString::number(lane.stats.nodes));
+      table_->item(row, kMemoryColumn)->setText(QString::number(lane.stats.bytes / 1048576.0, 'f', 1) + " MB");
+      ShowTree(lane);
+    }
+    running |= !finished;
+  }
+  table_->resizeColumnsToContents();
+  if (!running) {
+    timer_->stop();
+  }
+}
+
+inline void ComparisonDialog::ShowTree(Lane &lane) {
+  lane.thread->wait();
+  delete lane.thread;
+  lane.thread = nullptr;
+  lane.updater = new SceneUpdater(lane.tree, lane.view, &lane.snapshot);
+  lane.updater->max_animated_nodes = 0;
+  QGraphicsView *view = lane.view;
+  lane.updater->on_shown = [view] {
+    view->fitInView(view->scene()->sceneRect(), Qt::KeepAspectRatio);
+  };
+  lane.updater->Update();
+}
+
+#endif // COMPARISON_IMPL
@@ -0,0 +1,77 @@
+#ifndef COMPARISON_H
+#define COMPARISON_H
+
+#include <QDialog>
+#include <QComboBox>
+#include <QSpinBox>
+#include <QPushButton>
+#include <QTableWidget>
+#include <QGraphicsView>
+#include <QThread>
+#include <QTimer>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "TreeEngine.h"
+#include "Visualization.h"
+#include "KeyPermutation.h"
+#include "Reclaimer.h"
+
+// Runs the same stream of operations against every engine at once, one
+// worker thread per engine, and shows their throughput and shape side by
+// side. Rotation and split counts come from the TraceCounter policy.
+class ComparisonDialog : public QDialog {
+ public:
+  enum Workload {
+    kRandomInserts,
+    kSequentialInserts,
+    // Half finds, a quarter inserts and a quarter erases of random keys.
+    kMixed
+  };
+
+  // Finished trees are handed to reclaimer, which must outlive the dialog.
+  ComparisonDialog(int factor, Reclaimer *reclaimer, QWidget *parent = nullptr);
+
+  // Stops the runs and waits for their threads.
+  ~ComparisonDialog();
+
+ private:
+  // One engine. The counters are written by its worker and polled by the
+  // GUI thread; the tree belongs to the worker until finished is set.
+  struct Lane {
+    QString name;
+    QThread *thread = nullptr;
+    VisualizableTree<int> *tree = nullptr;
+    std::atomic<uint64_t> done = 0, nanoseconds = 0, rotations = 0, restructures = 0;
+    std::atomic<bool> finished = false;
+    TreeStats stats;
+    QGraphicsView *view = nullptr;
+    SceneUpdater *updater = nullptr;
+    VisualizationData<int> snapshot;
+  };
+
+  int factor_;
+  Reclaimer *reclaimer_;
+  QComboBox *workload_;
+  QSpinBox *count_;
+  QPushButton *start_;
+  QTableWidget *table_;
+  QTimer *timer_;
+  std::vector<std::unique_ptr<Lane>> lanes_;
+  std::atomic<bool> cancel_ = false;
+
+  // The worker runs the engine itself, not through the adapter.
+  template <typename Engine>
+  void StartLane(Lane &lane, TreeAdapter<Engine> *adapter, Workload workload, int count, KeyPermutation keys);
+
+  void Start();
+
+  // Stops and discards the previous run.
+  void Stop();
+
+  void Refresh();
+
+  void ShowTree(Lane &lane);
+};
+
+#endif // COMPARISON_H
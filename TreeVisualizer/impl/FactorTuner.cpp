@@ -0,0 +1,80 @@
+#ifndef FACTORTUNER_IMPL
+#define FACTORTUNER_IMPL
+
+#include "FactorTuner.h"
+#include "BTree.h"
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <random>
+
+inline const std::vector<FactorTuner::Timing>& FactorTuner::Timings() const {
+  return timings_;
+}
+
+template <typename T, typename Compare>
+int FactorTuner::Tune(const std::vector<T> &keys) {
+  timings_.clear();
+  if (keys.empty()) {
+    return 0;
+  }
+  std::mt19937_64 rng(seed);
+  // A random sample in random order, so that the order the keys come in
+  // (e.g. a preorder snapshot) does not favor any factor.
+  std::vector<T> sample = keys;
+  size_t size = std::min(sample_size, sample.size());
+  for (size_t i = 0; i < size; i++) {
+    std::swap(sample[i], sample[i + rng() % (sample.size() - i)]);
+  }
+  sample.resize(size);
+  // Per operation: index of its key, the top bit set for an update.
+  constexpr uint32_t kUpdate = 1u << 31;
+  std::vector<uint32_t> mix(operations);
+  std::uniform_real_distribution<double> share(0, 1);
+  for (uint32_t &operation : mix) {
+    operation = uint32_t(rng() % size) | (share(rng) < find_share ? 0 : kUpdate);
+  }
+  int best = 0;
+  double best_time = std::numeric_limits<double>::infinity();
+  for (int factor : candidates) {
+    double time = std::numeric_limits<double>::infinity();
+    for (int round = 0; round < rounds; round++) {
+      time = std::min(time, Measure<T, Compare>(factor, sample, mix));
+    }
+    timings_.push_back({factor, time});
+    if (time < best_time) {
+      best = factor;
+      best_time = time;
+    }
+  }
+  return best;
+}
+
+template <typename T, typename Compare>
+double FactorTuner::Measure(int factor, const std::vector<T> &sample, const std::vector<uint32_t> &mix) const {
+  constexpr uint32_t kUpdate = 1u << 31;
+  auto start = std::chrono::steady_clock::now();
+  size_t found = 0;
+  {
+    // Freeing the tree is part of its cost as well.
+    BTree<T, Compare> tree(factor);
+    tree.InsertAll(sample.begin(), sample.end());
+    for (uint32_t operation : mix) {
+      const T &key = sample[operation & ~kUpdate];
+      if (operation & kUpdate) {
+        tree.Erase(key);
+        tree.Insert(key);
+      } else {
+        found += tree.Find(key);
+      }
+    }
+  }
+  double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  // Keeps the finds from being optimized out.
+  if (found > mix.size()) {
+    return 0;
+  }
+  return elapsed / (sample.size() + mix.size());
+}
+
+#endif // FACTORTUNER_IMPL
@@ -0,0 +1,41 @@
+#ifndef FACTORTUNER_H
+#define FACTORTUNER_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Picks the B-Tree factor that runs a workload fastest on this machine. Every
+// candidate builds a tree from a sample of the keys, then runs a mix of finds
+// and updates on it; the best of a few rounds counts.
+class FactorTuner {
+ public:
+  struct Timing {
+    int factor;
+    double ns_per_op;
+  };
+
+  std::vector<int> candidates = {2, 4, 8, 16, 32, 64, 128, 256};
+  // Keys drawn into the sample, and operations in the mix after building.
+  size_t sample_size = 1 << 16, operations = 1 << 17;
+  // Share of finds in the mix; each of the other operations erases a key and
+  // inserts it back.
+  double find_share = 0.5;
+  int rounds = 3;
+  uint64_t seed = 1;
+
+  // Times every candidate and returns the fastest factor, or 0 without keys.
+  template <typename T, typename Compare = std::less<T>>
+  int Tune(const std::vector<T> &keys);
+
+  // Results of the last Tune, in the order of the candidates.
+  const std::vector<Timing>& Timings() const;
+
+ private:
+  std::vector<Timing> timings_;
+
+  template <typename T, typename Compare>
+  double Measure(int factor, const std::vector<T> &sample, const std::vector<uint32_t> &mix) const;
+};
+
+#endif // FACTORTUNER_H
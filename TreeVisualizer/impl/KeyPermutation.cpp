@@ -0,0 +1,33 @@
+#ifndef KEYPERMUTATION_IMPL
+#define KEYPERMUTATION_IMPL
+
+#include "KeyPermutation.h"
+#include <chrono>
+
+inline KeyPermutation::KeyPermutation()
+    : KeyPermutation(std::chrono::steady_clock::now().time_since_epoch().count()) {}
+
+inline KeyPermutation::KeyPermutation(uint64_t seed)
+    : seed0_(uint32_t(seed) & kMask), seed1_(uint32_t(seed >> 32) & kMask) {}
+
+// Every step is invertible modulo 2^30, so Mix permutes [0, 2^30).
+inline uint32_t KeyPermutation::Mix(uint32_t x) const {
+  x = (x ^ seed0_) & kMask;
+  x = (x * 0x2545F491u) & kMask;
+  x ^= x >> 15;
+  x = (x * 0x3C6EF35Fu) & kMask;
+  x ^= x >> 13;
+  return (x + seed1_) & kMask;
+}
+
+// Cycle-walking: re-applying Mix until the value falls back into
+// [0, kRange) restricts the permutation of [0, 2^30) to [0, kRange).
+inline int KeyPermutation::operator()(uint32_t index) const {
+  uint32_t x = index;
+  do {
+    x = Mix(x);
+  } while (x >= kRange);
+  return int(x) + 1;
+}
+
+#endif // KEYPERMUTATION_IMPL
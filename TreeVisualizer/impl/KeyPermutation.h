@@ -0,0 +1,26 @@
+#ifndef KEYPERMUTATION_H
+#define KEYPERMUTATION_H
+
+#include <cstdint>
+
+// Bijection of [0, kRange) onto the keys [1, kRange], so consecutive indices
+// give distinct pseudo-random keys without checking the tree for duplicates.
+class KeyPermutation {
+ public:
+  static constexpr uint32_t kRange = 1000000000;
+
+  KeyPermutation();
+
+  KeyPermutation(uint64_t seed);
+
+  int operator()(uint32_t index) const;
+
+ private:
+  static constexpr uint32_t kMask = (1u << 30) - 1;
+
+  uint32_t seed0_, seed1_;
+
+  uint32_t Mix(uint32_t x) const;
+};
+
+#endif // KEYPERMUTATION_H
@@ -0,0 +1,66 @@
+#ifndef OPERATIONTRACE_IMPL
+#define OPERATIONTRACE_IMPL
+
+#include "OperationTrace.h"
+#include <algorithm>
+
+inline const char* TraceEvent::Name(Kind kind) {
+  static const char *names[] = {"insert", "erase", "find", "visit", "rotate_left", "rotate_right",
+                                "split", "merge", "borrow", "zig", "zig_zig", "zig_zag", "rebuild"};
+  return names[kind];
+}
+
+inline void TraceCounter::Record(TraceEvent::Kind kind, const void*, const void*) {
+  ++counts_[kind];
+}
+
+inline uint64_t TraceCounter::Count(TraceEvent::Kind kind) const {
+  return counts_[kind];
+}
+
+inline TraceRecorder::TraceRecorder(size_t capacity) : events_(std::max<size_t>(capacity, 1)) {}
+
+inline void TraceRecorder::Record(TraceEvent::Kind kind, const void *node, const void *other) {
+  TraceEvent &event = events_[next_ % events_.size()];
+  event.sequence = next_++;
+  event.node = reinterpret_cast<uintptr_t>(node);
+  event.other = reinterpret_cast<uintptr_t>(other);
+  event.kind = kind;
+}
+
+inline size_t TraceRecorder::Size() const {
+  return std::min<uint64_t>(next_, events_.size());
+}
+
+inline const TraceEvent& TraceRecorder::operator[](size_t index) const {
+  return events_[(next_ - Size() + index) % events_.size()];
+}
+
+inline void TraceRecorder::Clear() {
+  next_ = 0;
+}
+
+inline void TraceRecorder::LastPath(std::vector<uint64_t> &path) const {
+  path.clear();
+  for (size_t i = Size(); i > 0; i--) {
+    const TraceEvent &event = (*this)[i - 1];
+    if (event.kind <= TraceEvent::kFind) {
+      break;
+    }
+    if (event.kind == TraceEvent::kVisit) {
+      path.push_back(event.node);
+    }
+  }
+  std::reverse(path.begin(), path.end());
+}
+
+inline void TraceRecorder::Export(std::ostream &out) const {
+  out << "sequence,event,node,other\n";
+  for (size_t i = 0; i < Size(); i++) {
+    const TraceEvent &event = (*this)[i];
+    out << event.sequence << ',' << TraceEvent::Name(event.kind) << ','
+        << event.node << ',' << event.other << '\n';
+  }
+}
+
+#endif // OPERATIONTRACE_IMPL
@@ -0,0 +1,91 @@
+#ifndef OPERATIONTRACE_H
+#define OPERATIONTRACE_H
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// One step of a tree operation. Nodes are identified by their address, like
+// the node ids of VisualizationData.
+struct TraceEvent {
+  enum Kind : uint8_t {
+    // Start of an operation.
+    kInsert,
+    kErase,
+    kFind,
+    // Node passed on the way down.
+    kVisit,
+    // Node rotated down, other is the node that took its place.
+    kRotateLeft,
+    kRotateRight,
+    // Treap: split step at node. B-Tree: node split off other.
+    kSplit,
+    // Treap: merge step of node with other. B-Tree: other merged into node.
+    kMerge,
+    // B-Tree: node took a key from its sibling other.
+    kBorrow,
+    // Splay step lifting node.
+    kZig,
+    kZigZig,
+    kZigZag,
+    // Scapegoat tree: subtree of node rebuilt balanced.
+    kRebuild
+  };
+
+  uint64_t sequence;
+  uint64_t node, other;
+  Kind kind;
+
+  static const char* Name(Kind kind);
+};
+
+// Trace policy of the engines that records nothing; its calls compile away.
+struct NoTrace {
+  static constexpr bool kEnabled = false;
+
+  void Record(TraceEvent::Kind, const void*, const void* = nullptr) {}
+};
+
+// Trace policy that only counts the events of each kind.
+class TraceCounter {
+ public:
+  static constexpr bool kEnabled = true;
+
+  void Record(TraceEvent::Kind kind, const void *node, const void *other = nullptr);
+
+  uint64_t Count(TraceEvent::Kind kind) const;
+
+ private:
+  uint64_t counts_[TraceEvent::kRebuild + 1] = {};
+};
+
+// Trace policy keeping the latest events in a ring buffer allocated up front,
+// so that recording is a handful of stores.
+class TraceRecorder {
+ public:
+  static constexpr bool kEnabled = true;
+
+  explicit TraceRecorder(size_t capacity = 1 << 16);
+
+  void Record(TraceEvent::Kind kind, const void *node, const void *other = nullptr);
+
+  // Number of events held, at most the capacity.
+  size_t Size() const;
+
+  // Held events, oldest first.
+  const TraceEvent& operator[](size_t index) const;
+
+  void Clear();
+
+  // Replaces path with the nodes visited by the last operation, in order.
+  void LastPath(std::vector<uint64_t> &path) const;
+
+  // Writes the held events as CSV: sequence, event, node, other.
+  void Export(std::ostream &out) const;
+
+ private:
+  std::vector<TraceEvent> events_;
+  uint64_t next_ = 0;
+};
+
+#endif // OPERATIONTRACE_H
@@ -0,0 +1,402 @@
+#ifndef PAGEDBTREE_IMPL
+#define PAGEDBTREE_IMPL
+
+#include "PagedBTree.h"
+#include "BufferPool.cpp"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+PagedBTree<T, Compare, Augment, Trace>::Page::Page(BufferPool &pool, uint32_t id)
+    : pool_(pool), id_(id), layout_(reinterpret_cast<Layout*>(pool.Pin(id))) {}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+PagedBTree<T, Compare, Augment, Trace>::Page::~Page() {
+  pool_.Unpin(id_, dirty_);
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+const PagedBTree<T, Compare, Augment, Trace>::Layout* PagedBTree<T, Compare, Augment, Trace>::Page::operator->() const {
+  return layout_;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+PagedBTree<T, Compare, Augment, Trace>::Layout& PagedBTree<T, Compare, Augment, Trace>::Page::Edit() {
+  dirty_ = true;
+  return *layout_;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+PagedBTree<T, Compare, Augment, Trace>::PagedBTree(const std::string &path, int factor_, size_t pool_pages)
+    : factor(factor_ == 0 ? kMaxFactor : std::clamp(factor_, 2, kMaxFactor)),
+      pool_(path, kPageSize, pool_pages) {}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+const void* PagedBTree<T, Compare, Augment, Trace>::TraceId(uint32_t page) {
+  return reinterpret_cast<const void*>(uintptr_t(page) + 1);
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+uint32_t PagedBTree<T, Compare, Augment, Trace>::NewPage(bool leaf) {
+  uint32_t id = pool_.Allocate();
+  Page page(pool_, id);
+  page.Edit().leaf = leaf;
+  return id;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+int PagedBTree<T, Compare, Augment, Trace>::LowerBound(const Page &page, T key) {
+  return std::lower_bound(page->keys, page->keys + page->count, key, less_) - page->keys;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void PagedBTree<T, Compare, Augment, Trace>::Insert(T value) {
+  trace_.Record(TraceEvent::kInsert, nullptr);
+  if (pool_.Failed()) {
+    return;
+  }
+  if (root_ == kNoPage) {
+    root_ = NewPage(true);
+  }
+  uint32_t cur = root_, par = kNoPage;
+  while (true) {
+    cur = FixOversaturation(cur, par);
+    Page page(pool_, cur);
+    if (pool_.Failed()) {
+      return;
+    }
+    trace_.Record(TraceEvent::kVisit, TraceId(cur));
+    int pos = LowerBound(page, value);
+    if (pos < int(page->count) && !less_(value, page->keys[pos])) {
+      return;
+    }
+    if (page->leaf) {
+      Layout &layout = page.Edit();
+      std::memmove(layout.keys + pos + 1, layout.keys + pos, (layout.count - pos) * sizeof(T));
+      layout.keys[pos] = value;
+      layout.count++;
+      return;
+    }
+    par = cur;
+    cur = page->children[pos];
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void PagedBTree<T, Compare, Augment, Trace>::Erase(T value) {
+  trace_.Record(TraceEvent::kErase, nullptr);
+  uint32_t cur = pool_.Failed() ? kNoPage : root_, par = kNoPage;
+  while (cur != kNoPage) {
+    cur = FixUndersaturation(cur, par);
+    par = cur;
+    uint32_t right_ch;
+    T last_min;
+    {
+      Page page(pool_, cur);
+      if (pool_.Failed()) {
+        return;
+      }
+      trace_.Record(TraceEvent::kVisit, TraceId(cur));
+      if (page->leaf) {
+        break;
+      }
+      int pos = LowerBound(page, value);
+      if (pos == int(page->count) || less_(value, page->keys[pos])) {
+        cur = page->children[pos];
+        continue;
+      }
+      // Swap with the minimum from the right child
+      right_ch = page->children[pos + 1];
+      uint32_t min_node = right_ch;
+      while (true) {
+        Page min_page(pool_, min_node);
+        if (pool_.Failed()) {
+          return;
+        }
+        if (min_page->leaf) {
+          last_min = min_page->keys[0];
+          std::swap(page.Edit().keys[pos], min_page.Edit().keys[0]);
+          break;
+        }
+        min_node = min_page->children[0];
+      }
+    }
+    // Go to the minimum fixing undersaturation. Nothing stays pinned: a
+    // merge below the root may release it.
+    while (true) {
+      uint32_t where;
+      {
+        Page right(pool_, right_ch);
+        if (pool_.Failed()) {
+          return;
+        }
+        if (right->leaf) {
+          break;
+        }
+        where = right->children[LowerBound(right, last_min)];
+      }
+      right_ch = FixUndersaturation(right_ch, par);
+      par = right_ch;
+      right_ch = where;
+    }
+    right_ch = FixUndersaturation(right_ch, par);
+    EraseInner(right_ch, value);
+    return;
+  }
+  if (cur != kNoPage && !pool_.Failed()) {
+    EraseInner(cur, value);
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+bool PagedBTree<T, Compare, Augment, Trace>::Find(T value) {
+  trace_.Record(TraceEvent::kFind, nullptr);
+  uint32_t cur = pool_.Failed() ? kNoPage : root_;
+  while (cur != kNoPage) {
+    Page page(pool_, cur);
+    if (pool_.Failed()) {
+      return false;
+    }
+    trace_.Record(TraceEvent::kVisit, TraceId(cur));
+    int pos = LowerBound(page, value);
+    if (pos < int(page->count) && !less_(value, page->keys[pos])) {
+      selected_ = cur;
+      return true;
+    }
+    cur = page->leaf ? kNoPage : page->children[pos];
+  }
+  return false;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void PagedBTree<T, Compare, Augment, Trace>::EraseInner(uint32_t node, T value) {
+  {
+    Page page(pool_, node);
+    if (pool_.Failed()) {
+      return;
+    }
+    // Linear: after the swap in Erase the key may be out of order here.
+    auto iter = std::find_if(page->keys, page->keys + page->count, [&](const T &key) {
+      return !less_(key, value) && !less_(value, key);
+    });
+    int pos = iter - page->keys;
+    if (pos == int(page->count)) {
+      return;
+    }
+    Layout &layout = page.Edit();
+    std::memmove(layout.keys + pos, layout.keys + pos + 1, (layout.count - pos - 1) * sizeof(T));
+    layout.count--;
+    if (layout.count > 0) {
+      return;
+    }
+  }
+  pool_.Release(node);
+  root_ = kNoPage;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+uint32_t PagedBTree<T, Compare, Augment, Trace>::FixOversaturation(uint32_t node, uint32_t par) {
+  Page page(pool_, node);
+  if (pool_.Failed() || int(page->count) < 2 * factor - 1) {
+    return node;
+  }
+  uint32_t brother = NewPage(page->leaf);
+  Page brother_page(pool_, brother);
+  trace_.Record(TraceEvent::kSplit, TraceId(brother), TraceId(node));
+  Layout &left = page.Edit(), &right = brother_page.Edit();
+  T med = left.keys[factor - 1];
+  right.count = left.count - factor;
+  std::memcpy(right.keys, left.keys + factor, right.count * sizeof(T));
+  std::memcpy(right.children, left.children + factor, (right.count + 1) * sizeof(uint32_t));
+  left.count = factor - 1;
+  if (par == kNoPage) {
+    root_ = NewPage(false);
+    Page root(pool_, root_);
+    Layout &layout = root.Edit();
+    layout.count = 1;
+    layout.keys[0] = med;
+    layout.children[0] = node;
+    layout.children[1] = brother;
+    return root_;
+  }
+  Page par_page(pool_, par);
+  if (pool_.Failed()) {
+    return par;
+  }
+  Layout &layout = par_page.Edit();
+  int pos = std::find(layout.children, layout.children + layout.count + 1, node) - layout.children;
+  std::memmove(layout.keys + pos + 1, layout.keys + pos, (layout.count - pos) * sizeof(T));
+  std::memmove(layout.children + pos + 2, layout.children + pos + 1, (layout.count - pos) * sizeof(uint32_t));
+  layout.keys[pos] = med;
+  layout.children[pos + 1] = brother;
+  layout.count++;
+  return par;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+uint32_t PagedBTree<T, Compare, Augment, Trace>::FixUndersaturation(uint32_t node, uint32_t par) {
+  if (par == kNoPage) {
+    return node;
+  }
+  uint32_t merged, removed;
+  bool empty_root;
+  {
+    Page page(pool_, node), par_page(pool_, par);
+    if (pool_.Failed() || int(page->count) > factor - 1) {
+      return node;
+    }
+    Layout &p = par_page.Edit();
+    int pos = std::find(p.children, p.children + p.count + 1, node) - p.children;
+    if (pos + 1 <= int(p.count)) {
+      Page right(pool_, p.children[pos + 1]);
+      if (pool_.Failed()) {
+        return node;
+      }
+      if (int(right->count) >= factor) {
+        trace_.Record(TraceEvent::kBorrow, TraceId(node), TraceId(p.children[pos + 1]));
+        Layout &n = page.Edit(), &r = right.Edit();
+        n.keys[n.count] = p.keys[pos];
+        n.children[n.count + 1] = r.children[0];
+        n.count++;
+        p.keys[pos] = r.keys[0];
+        std::memmove(r.keys, r.keys + 1, (r.count - 1) * sizeof(T));
+        std::memmove(r.children, r.children + 1, r.count * sizeof(uint32_t));
+        r.count--;
+        return node;
+      }
+    }
+    if (pos - 1 >= 0) {
+      Page left(pool_, p.children[pos - 1]);
+      if (pool_.Failed()) {
+        return node;
+      }
+      if (int(left->count) >= factor) {
+        trace_.Record(TraceEvent::kBorrow, TraceId(node), TraceId(p.children[pos - 1]));
+        Layout &n = page.Edit(), &l = left.Edit();
+        std::memmove(n.keys + 1, n.keys, n.count * sizeof(T));
+        std::memmove(n.children + 1, n.children, (n.count + 1) * sizeof(uint32_t));
+        n.keys[0] = p.keys[pos - 1];
+        n.children[0] = l.children[l.count];
+        n.count++;
+        p.keys[pos - 1] = l.keys[l.count - 1];
+        l.count--;
+        return node;
+      }
+    }
+    if (pos == int(p.count)) {
+      --pos;
+    }
+    merged = p.children[pos], removed = p.children[pos + 1];
+    Page left(pool_, merged), right(pool_, removed);
+    if (pool_.Failed()) {
+      return node;
+    }
+    trace_.Record(TraceEvent::kMerge, TraceId(merged), TraceId(removed));
+    Layout &l = left.Edit();
+    l.keys[l.count] = p.keys[pos];
+    std::memcpy(l.keys + l.count + 1, right->keys, right->count * sizeof(T));
+    std::memcpy(l.children + l.count + 1, right->children, (right->count + 1) * sizeof(uint32_t));
+    l.count += 1 + right->count;
+    std::memmove(p.keys + pos, p.keys + pos + 1, (p.count - pos - 1) * sizeof(T));
+    std::memmove(p.children + pos + 1, p.children + pos + 2, (p.count - pos - 1) * sizeof(uint32_t));
+    p.count--;
+    empty_root = p.count == 0;
+  }
+  // Released once unpinned.
+  pool_.Release(removed);
+  if (empty_root) {
+    assert(par == root_);
+    pool_.Release(par);
+    root_ = merged;
+  }
+  return merged;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void PagedBTree<T, Compare, Augment, Trace>::GetVisualizationData(VisualizationData<T> &data) {
+  data.Clear();
+  // Preorder with an explicit stack: page, index of its parent, child slot.
+  std::vector<std::tuple<uint32_t, int, int>> stack;
+  if (root_ != kNoPage) {
+    stack.emplace_back(root_, -1, 0);
+  }
+  while (!stack.empty()) {
+    auto [id, parent, slot] = stack.back();
+    stack.pop_back();
+    Page page(pool_, id);
+    if (pool_.Failed()) {
+      data.Clear();
+      break;
+    }
+    int index = data.AddNode(uint64_t(id) + 1, page->count + 1);
+    for (uint32_t i = 0; i < page->count; i++) {
+      data.AddKey(page->keys[i], VisualizationData<T>::kPlain, id == selected_);
+    }
+    if (parent != -1) {
+      data.SetChild(parent, slot, index);
+    }
+    if (!page->leaf) {
+      for (int i = page->count; i >= 0; i--) {
+        stack.emplace_back(page->children[i], index, i);
+      }
+    }
+  }
+  selected_ = kNoPage;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+const TraceRecorder* PagedBTree<T, Compare, Augment, Trace>::GetTrace() const {
+  if constexpr (std::is_same_v<Trace, TraceRecorder>) {
+    return &trace_;
+  } else {
+    return nullptr;
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+const Trace& PagedBTree<T, Compare, Augment, Trace>::GetTracePolicy() const {
+  return trace_;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+TreeStats PagedBTree<T, Compare, Augment, Trace>::GetStats() const {
+  TreeStats stats;
+  std::vector<std::pair<uint32_t, int>> stack;
+  if (root_ != kNoPage) {
+    stack.emplace_back(root_, 1);
+  }
+  while (!stack.empty()) {
+    auto [id, depth] = stack.back();
+    stack.pop_back();
+    Page page(pool_, id);
+    if (pool_.Failed()) {
+      break;
+    }
+    stats.keys += page->count;
+    stats.nodes++;
+    stats.height = std::max(stats.height, depth);
+    if (!page->leaf) {
+      for (uint32_t i = 0; i <= page->count; i++) {
+        stack.emplace_back(page->children[i], depth + 1);
+      }
+    }
+  }
+  stats.bytes = stats.nodes * kPageSize;
+  return stats;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+PagedBTree<T, Compare, Augment, Trace>::AugmentData PagedBTree<T, Compare, Augment, Trace>::GetAugment() const {
+  return AugmentData();
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+BufferPool& PagedBTree<T, Compare, Augment, Trace>::GetPool() {
+  return pool_;
+}
+
+#endif // PAGEDBTREE_IMPL
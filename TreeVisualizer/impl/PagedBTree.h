@@ -0,0 +1,115 @@
+#ifndef PAGEDBTREE_H
+#define PAGEDBTREE_H
+
+#include <string>
+#include <type_traits>
+#include "TreeEngine.h"
+#include "BufferPool.h"
+
+// B-Tree whose nodes are 4 KiB pages of a file, read and written through a
+// BufferPool, for key sets larger than memory. Insert and Erase are those of
+// BTree: top-down, splitting full nodes and filling thin ones on the way
+// down, so that a page is pinned only while it is being changed.
+//
+// Keys are stored as raw bytes. The pages keep no augment data, and
+// lookups go through the pool one by one.
+//
+// After an I/O error of the pool the tree stops where it is: updates do
+// nothing, lookups find nothing and the drawing is empty. An update cut
+// short is not finished.
+// Augment: see TreeEngine.h; Trace: see OperationTrace.h.
+template <typename T, typename Compare = std::less<T>, typename Augment = NoAugment, typename Trace = NoTrace>
+class PagedBTree : public BatchOperations<PagedBTree<T, Compare, Augment, Trace>, T> {
+  static_assert(std::is_trivially_copyable_v<T>, "PagedBTree keys are stored as raw bytes");
+  static_assert(!Augment::kEnabled, "PagedBTree pages have no room for augment data");
+
+ public:
+  using KeyType = T;
+  using AugmentData = typename Augment::Data;
+
+  static constexpr size_t kPageSize = 4096;
+  // Most keys a page holds, and the largest factor that stays within them.
+  static constexpr int kMaxKeys = (kPageSize - 3 * sizeof(uint32_t) - alignof(T)) / (sizeof(T) + sizeof(uint32_t));
+  static constexpr int kMaxFactor = (kMaxKeys + 1) / 2;
+
+  int factor;
+
+  // The file at path is created for the tree and lives as long as it.
+  // factor 0 takes kMaxFactor; pool_pages is the memory budget in pages.
+  PagedBTree(const std::string &path, int factor_ = 0, size_t pool_pages = 1024);
+
+  PagedBTree(const PagedBTree&) = delete;
+  PagedBTree& operator=(const PagedBTree&) = delete;
+
+  void Insert(T value);
+
+  void Erase(T value);
+
+  bool Find(T value);
+
+  void GetVisualizationData(VisualizationData<T> &data);
+
+  const TraceRecorder* GetTrace() const;
+
+  const Trace& GetTracePolicy() const;
+
+  // Reads every page.
+  TreeStats GetStats() const;
+
+  AugmentData GetAugment() const;
+
+  BufferPool& GetPool();
+
+ private:
+  struct Layout {
+    uint32_t count;
+    uint32_t leaf;
+    T keys[kMaxKeys];
+    uint32_t children[kMaxKeys + 1];
+  };
+  static_assert(sizeof(Layout) <= kPageSize);
+
+  // A pinned page, unpinned when it goes out of scope.
+  class Page {
+   public:
+    Page(BufferPool &pool, uint32_t id);
+
+    ~Page();
+
+    Page(const Page&) = delete;
+    Page& operator=(const Page&) = delete;
+
+    const Layout* operator->() const;
+
+    // For writing; marks the page dirty.
+    Layout& Edit();
+
+   private:
+    BufferPool &pool_;
+    uint32_t id_;
+    Layout *layout_;
+    bool dirty_ = false;
+  };
+
+  static constexpr uint32_t kNoPage = BufferPool::kNoPage;
+
+  mutable BufferPool pool_;
+  uint32_t root_ = kNoPage, selected_ = kNoPage;
+  [[no_unique_address]] Compare less_;
+  [[no_unique_address]] Trace trace_;
+
+  // Pages stand for nodes in the trace.
+  static const void* TraceId(uint32_t page);
+
+  uint32_t NewPage(bool leaf);
+
+  int LowerBound(const Page &page, T key);
+
+  void EraseInner(uint32_t node, T key);
+
+  uint32_t FixOversaturation(uint32_t node, uint32_t par);
+
+  uint32_t FixUndersaturation(uint32_t node, uint32_t par);
+};
+
+#endif // PAGEDBTREE_H
@@ -0,0 +1,110 @@
+#ifndef PERFCOUNTERS_IMPL
+#define PERFCOUNTERS_IMPL
+
+#include "PerfCounters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#include <utility>
+#endif
+
+inline const char* PerfCounters::Name(Counter counter) {
+  static const char *names[] = {"cycles", "instructions", "l1d_misses", "llc_misses", "dtlb_misses",
+                                "branch_misses"};
+  return names[counter];
+}
+
+#ifdef __linux__
+
+inline PerfCounters::PerfCounters() {
+  auto Cache = [](uint64_t cache) {
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  };
+  const std::pair<uint32_t, uint64_t> events[kCounterCount] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, Cache(PERF_COUNT_HW_CACHE_L1D)},
+    {PERF_TYPE_HW_CACHE, Cache(PERF_COUNT_HW_CACHE_LL)},
+    {PERF_TYPE_HW_CACHE, Cache(PERF_COUNT_HW_CACHE_DTLB)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+  };
+  // Opened one by one rather than as a group, so that one missing counter
+  // (common in VMs) does not take the others down with it.
+  for (int i = 0; i < kCounterCount; i++) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[i].first;
+    attr.config = events[i].second;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    fds_[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    values_[i] = -1;
+  }
+}
+
+inline PerfCounters::~PerfCounters() {
+  for (int fd : fds_) {
+    if (fd != -1) {
+      close(fd);
+    }
+  }
+}
+
+inline void PerfCounters::Start() {
+  for (int fd : fds_) {
+    if (fd != -1) {
+      ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+}
+
+inline void PerfCounters::Stop() {
+  for (int fd : fds_) {
+    if (fd != -1) {
+      ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+  }
+  for (int i = 0; i < kCounterCount; i++) {
+    values_[i] = -1;
+    // Value, time enabled, time running.
+    uint64_t data[3];
+    if (fds_[i] != -1 && read(fds_[i], data, sizeof(data)) == sizeof(data) && data[2] > 0) {
+      values_[i] = int64_t(double(data[0]) * data[1] / data[2]);
+    }
+  }
+}
+
+#else
+
+inline PerfCounters::PerfCounters() {
+  for (int i = 0; i < kCounterCount; i++) {
+    fds_[i] = -1;
+    values_[i] = -1;
+  }
+}
+
+inline PerfCounters::~PerfCounters() = default;
+
+inline void PerfCounters::Start() {}
+
+inline void PerfCounters::Stop() {}
+
+#endif
+
+inline bool PerfCounters::Available(Counter counter) const {
+  return fds_[counter] != -1;
+}
+
+inline int64_t PerfCounters::Value(Counter counter) const {
+  return values_[counter];
+}
+
+#endif // PERFCOUNTERS_IMPL
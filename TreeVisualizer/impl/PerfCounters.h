@@ -0,0 +1,47 @@
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <cstdint>
+
+// Hardware counters of the calling thread, read through perf_event_open on
+// Linux. Counters the kernel or the CPU refuses, and all of them elsewhere,
+// are reported as unavailable instead of failing.
+class PerfCounters {
+ public:
+  enum Counter {
+    kCycles,
+    kInstructions,
+    kL1dMisses,
+    kLlcMisses,
+    kDtlbMisses,
+    kBranchMisses,
+    kCounterCount
+  };
+
+  static const char* Name(Counter counter);
+
+  PerfCounters();
+
+  ~PerfCounters();
+
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+
+  bool Available(Counter counter) const;
+
+  // Resets and starts all counters.
+  void Start();
+
+  // Stops the counters and reads them.
+  void Stop();
+
+  // Count between the last Start and Stop, scaled up if the kernel had to
+  // multiplex the counter; -1 if unavailable.
+  int64_t Value(Counter counter) const;
+
+ private:
+  int fds_[kCounterCount];
+  int64_t values_[kCounterCount];
+};
+
+#endif // PERFCOUNTERS_H
@@ -2,10 +2,32 @@
 #define RBTREE_IMPL
 
 #include "RBTree.h"
+#include <type_traits>
+#include <vector>
+#include <tuple>
+#include <utility>
 #include <algorithm>
 
-template <typename T>
-void RBTree<T>::CutParent(Node* node) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+RBTree<T, Compare, Augment, Trace>::~RBTree() {
+  std::vector<Node*> stack;
+  if (root_ != nullptr) {
+    stack.push_back(root_);
+  }
+  while (!stack.empty()) {
+    Node *node = stack.back();
+    stack.pop_back();
+    for (Node *child : {node->left_, node->right_}) {
+      if (child != nullptr) {
+        stack.push_back(child);
+      }
+    }
+    delete node;
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void RBTree<T, Compare, Augment, Trace>::CutParent(Node* node) {
   if (node && node->parent_) {
     if (node->parent_->left_ == node) {
       node->parent_->left_ = nullptr;
@@ -16,8 +38,8 @@ void RBTree<T>::CutParent(Node* node) {
   }
 }
 
-template <typename T>
-void RBTree<T>::LinkLeft(Node *node, Node *parent) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+void RBTree<T, Compare, Augment, Trace>::LinkLeft(Node *node, Node *parent) {
   if (parent) {
     parent->left_ = node;
   }
@@ -26,8 +48,8 @@ void RBTree<T>::LinkLeft(Node *node, Node *parent) {
   }
 }
 
-template <typename T>
-void RBTree<T>::LinkRight(Node *node, Node *parent) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+void RBTree<T, Compare, Augment, Trace>::LinkRight(Node *node, Node *parent) {
   if (parent) {
     parent->right_ = node;
   }
@@ -36,19 +58,38 @@ void RBTree<T>::LinkRight(Node *node, Node *parent) {
   }
 }
 
-template <typename T>
-bool RBTree<T>::IsLeft(Node *x) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+bool RBTree<T, Compare, Augment, Trace>::IsLeft(Node *x) {
   return x && x->parent_ && x->parent_->left_ == x;
 }
 
-template <typename T>
-bool RBTree<T>::IsRight(Node *x) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+bool RBTree<T, Compare, Augment, Trace>::IsRight(Node *x) {
   return x && x->parent_ && x->parent_->right_ == x;
 }
 
-template <typename T>
-RBTree<T>::Node* RBTree<T>::RotateLeft(Node *x) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+void RBTree<T, Compare, Augment, Trace>::UpdateAugment(Node *x) {
+  if constexpr (Augment::kEnabled) {
+    const AugmentData *children[] = {x->left_ ? &x->left_->augment_ : nullptr,
+                                     x->right_ ? &x->right_->augment_ : nullptr};
+    Augment::template Update<T>(x->augment_, {&x->value, 1}, children);
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void RBTree<T, Compare, Augment, Trace>::UpdatePath(Node *x) {
+  if constexpr (Augment::kEnabled) {
+    for (; x != nullptr; x = x->parent_) {
+      UpdateAugment(x);
+    }
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+RBTree<T, Compare, Augment, Trace>::Node* RBTree<T, Compare, Augment, Trace>::RotateLeft(Node *x) {
   Node *y = x->right_, *beta = y->left_, *parent = x->parent_;
+  trace_.Record(TraceEvent::kRotateLeft, x, y);
   bool is_left = IsLeft(x);
   CutParent(x), CutParent(y), CutParent(beta);
   if (is_left) {
@@ -60,12 +101,14 @@ RBTree<T>::Node* RBTree<T>::RotateLeft(Node *x) {
   if (root_ == x) {
     root_ = y;
   }
+  UpdateAugment(x), UpdateAugment(y);
   return y;
 }
 
-template <typename T>
-RBTree<T>::Node* RBTree<T>::RotateRight(Node *x) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+RBTree<T, Compare, Augment, Trace>::Node* RBTree<T, Compare, Augment, Trace>::RotateRight(Node *x) {
   Node *y = x->left_, *beta = y->right_, *parent = x->parent_;
+  trace_.Record(TraceEvent::kRotateRight, x, y);
   bool is_left = IsLeft(x);
   CutParent(x), CutParent(y), CutParent(beta);
   if (is_left) {
@@ -77,49 +120,100 @@ RBTree<T>::Node* RBTree<T>::RotateRight(Node *x) {
   if (root_ == x) {
     root_ = y;
   }
+  UpdateAugment(x), UpdateAugment(y);
   return y;
 }
 
-template <typename T>
-RBTree<T>::Node* RBTree<T>::GetBrother(Node *x) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+RBTree<T, Compare, Augment, Trace>::Node* RBTree<T, Compare, Augment, Trace>::GetBrother(Node *x) {
   return IsLeft(x) ? x->parent_->right_ : x->parent_->left_;
 }
 
-template <typename T>
-RBTree<T>::Node::Color RBTree<T>::GetColor(Node *x) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+RBTree<T, Compare, Augment, Trace>::Node::Color RBTree<T, Compare, Augment, Trace>::GetColor(Node *x) {
   return x ? x->color_ : Node::kBlack;
 }
 
-template <typename T>
-RBTree<T>::Node* RBTree<T>::FindNode(T value) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+RBTree<T, Compare, Augment, Trace>::Node* RBTree<T, Compare, Augment, Trace>::FindNode(T value) {
   Node *current = root_;
   while (current) {
-    if (value < current->value) {
+    trace_.Record(TraceEvent::kVisit, current);
+    if (less_(value, current->value)) {
       current = current->left_;
-    } else if (value == current->value) {
-      return current;
-    } else {
+    } else if (less_(current->value, value)) {
       current = current->right_;
+    } else {
+      return current;
     }
   }
   return current;
 }
 
-template <typename T>
-void RBTree<T>::Insert(T value) {
-  Node *current = root_, *parent = nullptr;
+template <typename T, typename Compare, typename Augment, typename Trace>
+bool RBTree<T, Compare, Augment, Trace>::FingerHolds(T value) {
+  return finger_ != nullptr && (finger_prev_ == nullptr || less_(finger_prev_->value, value)) &&
+         (finger_next_ == nullptr || less_(value, finger_next_->value));
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+RBTree<T, Compare, Augment, Trace>::Node* RBTree<T, Compare, Augment, Trace>::Climb(Node *hint, T value,
+                                                                                  Node *&prev, Node *&next) {
+  // Past the hint, the subtree of a node is bounded on that side by the
+  // first ancestor entered from the other side.
+  Node *node = hint;
+  if (less_(node->value, value)) {
+    while (IsRight(node) || (IsLeft(node) && !less_(value, node->parent_->value))) {
+      node = node->parent_;
+    }
+    next = node->parent_;
+  } else if (less_(value, node->value)) {
+    while (IsLeft(node) || (IsRight(node) && !less_(node->parent_->value, value))) {
+      node = node->parent_;
+    }
+    prev = node->parent_;
+  }
+  return node;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void RBTree<T, Compare, Augment, Trace>::Insert(T value) {
+  Insert(FingerHolds(value) ? finger_ : nullptr, value);
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+RBTree<T, Compare, Augment, Trace>::Node* RBTree<T, Compare, Augment, Trace>::Insert(Node *hint, T value) {
+  trace_.Record(TraceEvent::kInsert, nullptr);
+  Node *current = root_, *parent = nullptr, *prev = nullptr, *next = nullptr;
+  if (hint != nullptr && hint == finger_ && FingerHolds(value)) {
+    // The place is below the finger or below its neighbour inside its
+    // subtree, which has no child on that side. The finger bounds value on
+    // one side, the neighbour on the other.
+    if (less_(finger_->value, value)) {
+      prev = finger_, next = finger_next_;
+      current = finger_->right_ ? finger_next_ : finger_;
+    } else if (less_(value, finger_->value)) {
+      prev = finger_prev_, next = finger_;
+      current = finger_->left_ ? finger_prev_ : finger_;
+    } else {
+      current = finger_;
+    }
+  } else if (hint != nullptr) {
+    current = Climb(hint, value, prev, next);
+  }
   bool is_left = false;
   while (current) {
-    if (value < current->value) {
-      parent = current;
+    trace_.Record(TraceEvent::kVisit, current);
+    if (less_(value, current->value)) {
+      parent = next = current;
       current = current->left_;
       is_left = true;
-    } else if (value == current->value) {
-      return;
-    } else {
-      parent = current;
+    } else if (less_(current->value, value)) {
+      parent = prev = current;
       current = current->right_;
       is_left = false;
+    } else {
+      return current;
     }
   }
   current = new Node(value);
@@ -131,104 +225,105 @@ void RBTree<T>::Insert(T value) {
   if (root_ == nullptr) {
     root_ = current;
   }
+  finger_ = current, finger_prev_ = prev, finger_next_ = next;
+  UpdatePath(current);
   RebalanceInsert(current);
+  return current;
 }
 
-template <typename T>
-void RBTree<T>::Erase(Node *node) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+void RBTree<T, Compare, Augment, Trace>::Erase(Node *node) {
+  // Values move between nodes below.
+  finger_ = finger_prev_ = finger_next_ = nullptr;
   if (node->left_) {
     Node* max_node = node->left_;
     while (max_node->right_) {
       max_node = max_node->right_;
     }
     std::swap(node->value, max_node->value);
-    RebalanceErase(max_node);
-    CutParent(max_node);
-    delete max_node;
+    node = max_node;
   } else if (node->right_) {
     Node* min_node = node->right_;
     while (min_node->left_) {
       min_node = min_node->left_;
     }
     std::swap(node->value, min_node->value);
-    RebalanceErase(min_node);
-    CutParent(min_node);
-    delete min_node;
-  } else {
-    RebalanceErase(node);
-    CutParent(node);
-    if (node == root_) {
-      root_ = nullptr;
-    }
-    delete node;
+    node = min_node;
   }
+  RebalanceErase(node);
+  Node *parent = node->parent_;
+  CutParent(node);
+  if (node == root_) {
+    root_ = nullptr;
+  }
+  delete node;
+  UpdatePath(parent);
 }
 
-template <typename T>
-bool RBTree<T>::CheckInvariant() {
-  auto DFS = [&](auto&& self, Node *node) -> int {
-    if (node == nullptr) {
-      return 0;
-    } else if (node->parent_ && node->color_ == Node::kRed &&
-               node->parent_->color_ == Node::kRed) {
-      return -1;
-    } else {
-      int left_val = self(self, node->left_);
-      int right_val = self(self, node->right_);
-      if (node->left_ && node->left_->value >= node->value) {
-        return -1;
-      }
-      if (node->right_ && node->right_->value <= node->value) {
-        return -1;
-      }
-      if (left_val == -1 || right_val == -1) {
-        return -1;
+template <typename T, typename Compare, typename Augment, typename Trace>
+bool RBTree<T, Compare, Augment, Trace>::CheckInvariant() {
+  std::vector<Node*> stack;
+  if (root_ != nullptr) {
+    stack.push_back(root_);
+  }
+  while (!stack.empty()) {
+    Node *node = stack.back();
+    stack.pop_back();
+    if (node->parent_ && node->color_ == Node::kRed && node->parent_->color_ == Node::kRed) {
+      return false;
+    }
+    if (node->left_ && !less_(node->left_->value, node->value)) {
+      return false;
+    }
+    if (node->right_ && !less_(node->value, node->right_->value)) {
+      return false;
+    }
+    for (Node *child : {node->left_, node->right_}) {
+      if (child != nullptr) {
+        stack.push_back(child);
       }
-      return left_val + (node->color_ == Node::kBlack);
     }
-  };
-  return DFS(DFS, root_) != -1;
+  }
+  return true;
 }
 
-template <typename T>
-void RBTree<T>::RebalanceInsert(Node *node) {
-  if (node == root_) {
-    node->color_ = Node::kBlack;
-  } else if (node->parent_->color_ == Node::kBlack) {
-    return;
-  } else {
+template <typename T, typename Compare, typename Augment, typename Trace>
+void RBTree<T, Compare, Augment, Trace>::RebalanceInsert(Node *node) {
+  // Recoloring moves the violation two levels up; a rotation ends it.
+  while (node != root_ && node->parent_->color_ == Node::kRed) {
     Node *p = node->parent_, *gp = p->parent_;
     Node *uncle = GetBrother(p);
     if (GetColor(uncle) == Node::kRed) {
       gp->color_ = Node::kRed;
       uncle->color_ = p->color_ = Node::kBlack;
-      RebalanceInsert(gp);
+      node = gp;
+      continue;
+    }
+    if (IsLeft(p) == IsLeft(node)) {
+      if (IsLeft(p)) {
+        RotateRight(gp);
+      } else {
+        RotateLeft(gp);
+      }
+      p->color_ = Node::kBlack;
     } else {
-      if (IsLeft(p) == IsLeft(node)) {
-        if (IsLeft(p)) {
-          RotateRight(gp);
-        } else {
-          RotateLeft(gp);
-        }
-        p->color_ = Node::kBlack;
-        gp->color_ = Node::kRed;
+      if (IsLeft(p)) {
+        RotateLeft(p);
+        RotateRight(gp);
       } else {
-        if (IsLeft(p)) {
-          RotateLeft(p);
-          RotateRight(gp);
-        } else {
-          RotateRight(p);
-          RotateLeft(gp);
-        }
-        gp->color_ = Node::kRed;
-        node->color_ = Node::kBlack;
+        RotateRight(p);
+        RotateLeft(gp);
       }
+      node->color_ = Node::kBlack;
     }
+    gp->color_ = Node::kRed;
+    break;
   }
+  root_->color_ = Node::kBlack;
 }
 
-template <typename T>
-void RBTree<T>::RebalanceErase(Node *node) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+void RBTree<T, Compare, Augment, Trace>::RebalanceErase(Node *node) {
   if (node->color_ != Node::kBlack || node->left_ || node->right_) {
     bool is_left = IsLeft(node);
     Node *child = node->left_ ? node->left_ : node->right_;
@@ -321,41 +416,112 @@ void RBTree<T>::RebalanceErase(Node *node) {
   }
 }
 
-template <typename T>
-bool RBTree<T>::Find(T value) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+bool RBTree<T, Compare, Augment, Trace>::Find(T value) {
+  trace_.Record(TraceEvent::kFind, nullptr);
   selected_ = FindNode(value);
   return selected_ != nullptr;
 }
 
-template <typename T>
-void RBTree<T>::Erase(T value) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+void RBTree<T, Compare, Augment, Trace>::Erase(T value) {
+  trace_.Record(TraceEvent::kErase, nullptr);
   Node *node = FindNode(value);
   if (node != nullptr) {
     Erase(node);
   }
 }
 
-template <typename T>
-VisualizationData* RBTree<T>::GetVisualizationData() {
-  auto DFS = [&](auto&& self, Node *node) -> VisualizationData* {
-    if (node == nullptr) {
-      return nullptr;
+template <typename T, typename Compare, typename Augment, typename Trace>
+size_t RBTree<T, Compare, Augment, Trace>::FindBatch(std::span<const T> keys, std::span<uint8_t> results) {
+  if constexpr (Trace::kEnabled) {
+    // One by one, so that the events of every lookup stay together.
+    return BatchOperations<RBTree, T>::FindBatch(keys, results);
+  } else {
+    return InterleaveLookups(keys, results, root_, [this](Node *&node, const T &key) {
+      using Step = std::pair<BatchStep, const void*>;
+      if (node == nullptr) {
+        return Step(BatchStep::kMissing, nullptr);
+      }
+      if (less_(key, node->value)) {
+        node = node->left_;
+      } else if (less_(node->value, key)) {
+        node = node->right_;
+      } else {
+        return Step(BatchStep::kFound, nullptr);
+      }
+      return Step(BatchStep::kPending, node);
+    });
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void RBTree<T, Compare, Augment, Trace>::GetVisualizationData(VisualizationData<T> &data) {
+  data.Clear();
+  // Preorder with an explicit stack: node, index of its parent, child slot.
+  std::vector<std::tuple<Node*, int, int>> stack;
+  if (root_ != nullptr) {
+    stack.emplace_back(root_, -1, 0);
+  }
+  while (!stack.empty()) {
+    auto [node, parent, slot] = stack.back();
+    stack.pop_back();
+    int index = data.AddNode(reinterpret_cast<uintptr_t>(node), 2);
+    auto color = node->color_ == Node::kRed ? VisualizationData<T>::kRed : VisualizationData<T>::kBlack;
+    data.AddKey(node->value, color, node == selected_);
+    if (parent != -1) {
+      data.SetChild(parent, slot, index);
     }
-    VisualizationData *data = new VisualizationData();
-    data->keys.push_back(std::to_string(node->value));
-    if (node == selected_) {
-      data->colors.push_back({QColor(Qt::green), QColor(Qt::white)});
-    } else if (node->color_ == Node::kRed) {
-      data->colors.push_back({QColor(Qt::red), QColor(Qt::white)});
-    } else {
-      data->colors.push_back({QColor(Qt::black), QColor(Qt::white)});
+    if (node->right_ != nullptr) {
+      stack.emplace_back(node->right_, index, 1);
+    }
+    if (node->left_ != nullptr) {
+      stack.emplace_back(node->left_, index, 0);
     }
-    data->children = {self(self, node->left_), self(self, node->right_)};
-    return data; 
-  };
-  VisualizationData* data = DFS(DFS, root_);
+  }
   selected_ = nullptr;
-  return data;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+const TraceRecorder* RBTree<T, Compare, Augment, Trace>::GetTrace() const {
+  if constexpr (std::is_same_v<Trace, TraceRecorder>) {
+    return &trace_;
+  } else {
+    return nullptr;
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+const Trace& RBTree<T, Compare, Augment, Trace>::GetTracePolicy() const {
+  return trace_;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+TreeStats RBTree<T, Compare, Augment, Trace>::GetStats() const {
+  TreeStats stats;
+  std::vector<std::pair<Node*, int>> stack;
+  if (root_ != nullptr) {
+    stack.emplace_back(root_, 1);
+  }
+  while (!stack.empty()) {
+    auto [node, depth] = stack.back();
+    stack.pop_back();
+    stats.keys++;
+    stats.height = std::max(stats.height, depth);
+    for (Node *child : {node->left_, node->right_}) {
+      if (child != nullptr) {
+        stack.emplace_back(child, depth + 1);
+      }
+    }
+  }
+  stats.nodes = stats.keys;
+  stats.bytes = stats.nodes * sizeof(Node);
+  return stats;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+RBTree<T, Compare, Augment, Trace>::AugmentData RBTree<T, Compare, Augment, Trace>::GetAugment() const {
+  return root_ != nullptr ? root_->augment_ : AugmentData();
 }
 
 #endif // RBTREE_IMPL
@@ -1,11 +1,15 @@
 #ifndef RBTREE_H
 #define RBTREE_H
 
-#include "Visualization.h"
+#include "TreeEngine.h"
 
-template <typename T>
-class RBTree : public VisualizableTree<T> {
+// Augment: see TreeEngine.h; Trace: see OperationTrace.h.
+template <typename T, typename Compare = std::less<T>, typename Augment = NoAugment, typename Trace = NoTrace>
+class RBTree : public BatchOperations<RBTree<T, Compare, Augment, Trace>, T> {
  public:
+  using KeyType = T;
+  using AugmentData = typename Augment::Data;
+
   class Node {
     friend class RBTree;
    public:
@@ -24,26 +28,62 @@ class RBTree : public VisualizableTree<T> {
     Node *left_ = nullptr, *right_ = nullptr;
     Node *parent_ = nullptr;
     Color color_ = kRed;
+    [[no_unique_address]] AugmentData augment_;
   };
 
   RBTree() = default;
 
-  VisualizationData* GetVisualizationData() override;
+  RBTree(const RBTree&) = delete;
+  RBTree& operator=(const RBTree&) = delete;
+
+  ~RBTree();
+
+  void GetVisualizationData(VisualizationData<T> &data);
+
+  const TraceRecorder* GetTrace() const;
+
+  const Trace& GetTracePolicy() const;
+
+  TreeStats GetStats() const;
+
+  // Augment data of the whole tree.
+  AugmentData GetAugment() const;
+
+  // Links keys that fall next to the last inserted one (sorted runs) without
+  // a search; others are searched from the root.
+  void Insert(T value);
+
+  // Searches from hint, a node of this tree or nullptr for the root: goes up
+  // only until an ancestor bounds value, then down. Returns the node of
+  // value.
+  Node* Insert(Node *hint, T value);
 
-  void Insert(T value) override;
-  
   Node* FindNode(T value);
 
-  bool Find(T value) override;
+  bool Find(T value);
+
+  // Interleaves the lookups unless the engine records a trace.
+  size_t FindBatch(std::span<const T> keys, std::span<uint8_t> results);
 
   void Erase(Node *node);
 
-  void Erase(T value) override;
+  void Erase(T value);
 
   bool CheckInvariant();
 
  private:
   Node *root_ = nullptr, *selected_ = nullptr;
+  // The last inserted node and its neighbours in key order, nullptr past the
+  // ends. Rotations keep the order, erases reset them.
+  Node *finger_ = nullptr, *finger_prev_ = nullptr, *finger_next_ = nullptr;
+  [[no_unique_address]] Compare less_;
+  [[no_unique_address]] Trace trace_;
+
+  bool FingerHolds(T value);
+
+  // Lowest ancestor of hint whose subtree may hold value; sets the bound
+  // found on the way up.
+  Node* Climb(Node *hint, T value, Node *&prev, Node *&next);
 
   void CutParent(Node *node);
 
@@ -55,6 +95,11 @@ class RBTree : public VisualizableTree<T> {
 
   bool IsRight(Node *node);
 
+  void UpdateAugment(Node *node);
+
+  // Updates the augment data from node up to the root.
+  void UpdatePath(Node *node);
+
   Node* RotateLeft(Node *node);
 
   Node* RotateRight(Node *node);
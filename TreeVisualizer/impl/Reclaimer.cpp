@@ -0,0 +1,65 @@
+#ifndef RECLAIMER_IMPL
+#define RECLAIMER_IMPL
+
+#include "Reclaimer.h"
+#include <utility>
+
+inline Reclaimer::Reclaimer() : thread_([this] { Run(); }) {}
+
+inline Reclaimer::~Reclaimer() {
+  {
+    std::lock_guard lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_one();
+  thread_.join();
+}
+
+template <typename T>
+void Reclaimer::Discard(T *object) {
+  if (object != nullptr) {
+    Push([object] {
+      delete object;
+    });
+  }
+}
+
+inline void Reclaimer::Drain() {
+  std::unique_lock lock(mutex_);
+  idle_.wait(lock, [this] {
+    return queue_.empty() && !busy_;
+  });
+}
+
+inline void Reclaimer::Push(std::function<void()> task) {
+  {
+    std::lock_guard lock(mutex_);
+    queue_.push_back(std::move(task));
+  }
+  wake_.notify_one();
+}
+
+inline void Reclaimer::Run() {
+  std::vector<std::function<void()>> tasks;
+  std::unique_lock lock(mutex_);
+  while (true) {
+    wake_.wait(lock, [this] {
+      return stop_ || !queue_.empty();
+    });
+    if (queue_.empty()) {
+      return;
+    }
+    tasks.swap(queue_);
+    busy_ = true;
+    lock.unlock();
+    for (auto &task : tasks) {
+      task();
+    }
+    tasks.clear();
+    lock.lock();
+    busy_ = false;
+    idle_.notify_all();
+  }
+}
+
+#endif // RECLAIMER_IMPL
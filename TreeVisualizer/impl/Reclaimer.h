@@ -0,0 +1,42 @@
+#ifndef RECLAIMER_H
+#define RECLAIMER_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Deletes discarded objects on a background thread, so that dropping a tree
+// of millions of nodes returns at once.
+class Reclaimer {
+ public:
+  Reclaimer();
+
+  // Deletes whatever is still queued, then stops the thread.
+  ~Reclaimer();
+
+  Reclaimer(const Reclaimer&) = delete;
+  Reclaimer& operator=(const Reclaimer&) = delete;
+
+  // Takes ownership of object; nullptr is ignored.
+  template <typename T>
+  void Discard(T *object);
+
+  // Blocks until everything discarded so far is deleted.
+  void Drain();
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable wake_, idle_;
+  std::vector<std::function<void()>> queue_;
+  bool busy_ = false, stop_ = false;
+  // Started last, once the rest is initialized.
+  std::thread thread_;
+
+  void Push(std::function<void()> task);
+
+  void Run();
+};
+
+#endif // RECLAIMER_H
@@ -0,0 +1,375 @@
+#ifndef SCAPEGOATTREE_IMPL
+#define SCAPEGOATTREE_IMPL
+
+#include "ScapegoatTree.h"
+#include <type_traits>
+#include <vector>
+#include <tuple>
+#include <utility>
+#include <algorithm>
+#include <cmath>
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+ScapegoatTree<T, Compare, Augment, Trace>::~ScapegoatTree() {
+  Clear();
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void ScapegoatTree<T, Compare, Augment, Trace>::Clear() {
+  // Iterative, the tree may be deep between rebuilds.
+  stack_.clear();
+  if (root_ != nullptr) {
+    stack_.push_back(root_);
+  }
+  while (!stack_.empty()) {
+    Node *node = stack_.back();
+    stack_.pop_back();
+    for (Node *child : {node->left_, node->right_}) {
+      if (child != nullptr) {
+        stack_.push_back(child);
+      }
+    }
+    delete node;
+  }
+  root_ = selected_ = nullptr;
+  size_ = max_size_ = 0;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+int ScapegoatTree<T, Compare, Augment, Trace>::MaxDepth(size_t size) {
+  return size > 1 ? int(std::log(double(size)) / std::log(1.5)) : 0;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void ScapegoatTree<T, Compare, Augment, Trace>::UpdateAugment(Node *x) {
+  if constexpr (Augment::kEnabled) {
+    const AugmentData *children[] = {x->left_ ? &x->left_->augment_ : nullptr,
+                                     x->right_ ? &x->right_->augment_ : nullptr};
+    Augment::template Update<T>(x->augment_, {&x->value, 1}, children);
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void ScapegoatTree<T, Compare, Augment, Trace>::UpdatePath() {
+  if constexpr (Augment::kEnabled) {
+    for (auto it = path_.rbegin(); it != path_.rend(); ++it) {
+      UpdateAugment(*it);
+    }
+  }
+  path_.clear();
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+size_t ScapegoatTree<T, Compare, Augment, Trace>::CountNodes(Node *node) {
+  size_t count = 0;
+  stack_.clear();
+  if (node != nullptr) {
+    stack_.push_back(node);
+  }
+  while (!stack_.empty()) {
+    Node *top = stack_.back();
+    stack_.pop_back();
+    count++;
+    for (Node *child : {top->left_, top->right_}) {
+      if (child != nullptr) {
+        stack_.push_back(child);
+      }
+    }
+  }
+  return count;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+ScapegoatTree<T, Compare, Augment, Trace>::Node* ScapegoatTree<T, Compare, Augment, Trace>::Rebuild(Node *node, size_t size) {
+  trace_.Record(TraceEvent::kRebuild, node);
+  // Flatten in order, then relink the same nodes.
+  nodes_.clear();
+  nodes_.reserve(size);
+  stack_.clear();
+  while (node != nullptr || !stack_.empty()) {
+    while (node != nullptr) {
+      stack_.push_back(node);
+      node = node->left_;
+    }
+    node = stack_.back();
+    stack_.pop_back();
+    nodes_.push_back(node);
+    node = node->right_;
+  }
+  return BuildBalanced();
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+ScapegoatTree<T, Compare, Augment, Trace>::Node* ScapegoatTree<T, Compare, Augment, Trace>::BuildBalanced() {
+  // Every range of nodes_ is linked through its median; stack_ ends up with
+  // the nodes in preorder, so walking it backwards updates children first.
+  Node *root = nullptr;
+  stack_.clear();
+  ranges_.clear();
+  ranges_.emplace_back(0, nodes_.size(), &root);
+  while (!ranges_.empty()) {
+    auto [begin, end, link] = ranges_.back();
+    ranges_.pop_back();
+    if (begin == end) {
+      *link = nullptr;
+      continue;
+    }
+    size_t middle = begin + (end - begin) / 2;
+    Node *node = nodes_[middle];
+    *link = node;
+    if constexpr (Augment::kEnabled) {
+      stack_.push_back(node);
+    }
+    ranges_.emplace_back(middle + 1, end, &node->right_);
+    ranges_.emplace_back(begin, middle, &node->left_);
+  }
+  for (auto it = stack_.rbegin(); it != stack_.rend(); ++it) {
+    UpdateAugment(*it);
+  }
+  return root;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+template <typename Iterator>
+void ScapegoatTree<T, Compare, Augment, Trace>::Build(Iterator first, Iterator last) {
+  Clear();
+  nodes_.clear();
+  for (; first != last; ++first) {
+    nodes_.push_back(new Node(*first));
+  }
+  root_ = BuildBalanced();
+  size_ = max_size_ = nodes_.size();
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+ScapegoatTree<T, Compare, Augment, Trace>::Node* ScapegoatTree<T, Compare, Augment, Trace>::FindNode(T value) {
+  Node *node = root_;
+  while (node) {
+    trace_.Record(TraceEvent::kVisit, node);
+    if (less_(value, node->value)) {
+      node = node->left_;
+    } else if (less_(node->value, value)) {
+      node = node->right_;
+    } else {
+      return node;
+    }
+  }
+  return node;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void ScapegoatTree<T, Compare, Augment, Trace>::Insert(T value) {
+  trace_.Record(TraceEvent::kInsert, nullptr);
+  path_.clear();
+  Node **link = &root_;
+  while (*link != nullptr) {
+    Node *node = *link;
+    trace_.Record(TraceEvent::kVisit, node);
+    if (less_(value, node->value)) {
+      link = &node->left_;
+    } else if (less_(node->value, value)) {
+      link = &node->right_;
+    } else {
+      path_.clear();
+      return;
+    }
+    path_.push_back(node);
+  }
+  Node *leaf = *link = new Node(value);
+  UpdateAugment(leaf);
+  size_++;
+  max_size_ = std::max(max_size_, size_);
+  if (int(path_.size()) > MaxDepth(size_)) {
+    // Too deep, so some ancestor has a child with over 2/3 of its subtree;
+    // the lowest such ancestor is the scapegoat.
+    Node *child = leaf;
+    size_t child_size = 1;
+    for (size_t i = path_.size(); i-- > 0;) {
+      Node *node = path_[i];
+      size_t size = child_size + 1 + CountNodes(node->left_ == child ? node->right_ : node->left_);
+      if (3 * child_size > 2 * size) {
+        Node **parent_link = i == 0 ? &root_ : path_[i - 1]->left_ == node ? &path_[i - 1]->left_
+                                                                            : &path_[i - 1]->right_;
+        *parent_link = Rebuild(node, size);
+        // The rebuild updated everything below.
+        path_.resize(i);
+        break;
+      }
+      child = node;
+      child_size = size;
+    }
+  }
+  UpdatePath();
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void ScapegoatTree<T, Compare, Augment, Trace>::Erase(T value) {
+  trace_.Record(TraceEvent::kErase, nullptr);
+  path_.clear();
+  Node **link = &root_;
+  while (*link != nullptr) {
+    Node *node = *link;
+    trace_.Record(TraceEvent::kVisit, node);
+    if (less_(value, node->value)) {
+      link = &node->left_;
+    } else if (less_(node->value, value)) {
+      link = &node->right_;
+    } else {
+      break;
+    }
+    path_.push_back(node);
+  }
+  Node *node = *link;
+  if (node == nullptr) {
+    path_.clear();
+    return;
+  }
+  if (node->left_ != nullptr && node->right_ != nullptr) {
+    // Take the successor's key and unlink the successor instead.
+    path_.push_back(node);
+    link = &node->right_;
+    while ((*link)->left_ != nullptr) {
+      path_.push_back(*link);
+      link = &(*link)->left_;
+    }
+    std::swap(node->value, (*link)->value);
+    node = *link;
+  }
+  *link = node->left_ != nullptr ? node->left_ : node->right_;
+  delete node;
+  size_--;
+  if (3 * size_ < 2 * max_size_) {
+    path_.clear();
+    root_ = Rebuild(root_, size_);
+    max_size_ = size_;
+  } else {
+    UpdatePath();
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+bool ScapegoatTree<T, Compare, Augment, Trace>::Find(T value) {
+  trace_.Record(TraceEvent::kFind, nullptr);
+  selected_ = FindNode(value);
+  return selected_ != nullptr;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+size_t ScapegoatTree<T, Compare, Augment, Trace>::FindBatch(std::span<const T> keys, std::span<uint8_t> results) {
+  if constexpr (Trace::kEnabled) {
+    // One by one, so that the events of every lookup stay together.
+    return BatchOperations<ScapegoatTree, T>::FindBatch(keys, results);
+  } else {
+    return InterleaveLookups(keys, results, root_, [this](Node *&node, const T &key) {
+      using Step = std::pair<BatchStep, const void*>;
+      if (node == nullptr) {
+        return Step(BatchStep::kMissing, nullptr);
+      }
+      if (less_(key, node->value)) {
+        node = node->left_;
+      } else if (less_(node->value, key)) {
+        node = node->right_;
+      } else {
+        return Step(BatchStep::kFound, nullptr);
+      }
+      return Step(BatchStep::kPending, node);
+    });
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+bool ScapegoatTree<T, Compare, Augment, Trace>::InvariantCheck() {
+  // Keys in order, no node deeper than an insert may leave it, and the
+  // size right.
+  std::vector<std::tuple<Node*, int, const T*, const T*>> stack;
+  if (root_ != nullptr) {
+    stack.emplace_back(root_, 0, nullptr, nullptr);
+  }
+  size_t count = 0;
+  while (!stack.empty()) {
+    auto [node, depth, low, high] = stack.back();
+    stack.pop_back();
+    count++;
+    if (depth > MaxDepth(max_size_) || (low != nullptr && !less_(*low, node->value)) ||
+        (high != nullptr && !less_(node->value, *high))) {
+      return false;
+    }
+    if (node->left_ != nullptr) {
+      stack.emplace_back(node->left_, depth + 1, low, &node->value);
+    }
+    if (node->right_ != nullptr) {
+      stack.emplace_back(node->right_, depth + 1, &node->value, high);
+    }
+  }
+  return count == size_;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void ScapegoatTree<T, Compare, Augment, Trace>::GetVisualizationData(VisualizationData<T> &data) {
+  data.Clear();
+  // Preorder with an explicit stack: node, index of its parent, child slot.
+  std::vector<std::tuple<Node*, int, int>> stack;
+  if (root_ != nullptr) {
+    stack.emplace_back(root_, -1, 0);
+  }
+  while (!stack.empty()) {
+    auto [node, parent, slot] = stack.back();
+    stack.pop_back();
+    int index = data.AddNode(reinterpret_cast<uintptr_t>(node), 2);
+    data.AddKey(node->value, VisualizationData<T>::kPlain, node == selected_);
+    if (parent != -1) {
+      data.SetChild(parent, slot, index);
+    }
+    if (node->right_ != nullptr) {
+      stack.emplace_back(node->right_, index, 1);
+    }
+    if (node->left_ != nullptr) {
+      stack.emplace_back(node->left_, index, 0);
+    }
+  }
+  selected_ = nullptr;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+const TraceRecorder* ScapegoatTree<T, Compare, Augment, Trace>::GetTrace() const {
+  if constexpr (std::is_same_v<Trace, TraceRecorder>) {
+    return &trace_;
+  } else {
+    return nullptr;
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+const Trace& ScapegoatTree<T, Compare, Augment, Trace>::GetTracePolicy() const {
+  return trace_;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+TreeStats ScapegoatTree<T, Compare, Augment, Trace>::GetStats() const {
+  TreeStats stats;
+  std::vector<std::pair<Node*, int>> stack;
+  if (root_ != nullptr) {
+    stack.emplace_back(root_, 1);
+  }
+  while (!stack.empty()) {
+    auto [node, depth] = stack.back();
+    stack.pop_back();
+    stats.keys++;
+    stats.height = std::max(stats.height, depth);
+    for (Node *child : {node->left_, node->right_}) {
+      if (child != nullptr) {
+        stack.emplace_back(child, depth + 1);
+      }
+    }
+  }
+  stats.nodes = stats.keys;
+  stats.bytes = stats.nodes * sizeof(Node);
+  return stats;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+ScapegoatTree<T, Compare, Augment, Trace>::AugmentData ScapegoatTree<T, Compare, Augment, Trace>::GetAugment() const {
+  return root_ != nullptr ? root_->augment_ : AugmentData();
+}
+
+#endif // SCAPEGOATTREE_IMPL
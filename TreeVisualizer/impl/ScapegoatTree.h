@@ -0,0 +1,100 @@
+#ifndef SCAPEGOATTREE_H
+#define SCAPEGOATTREE_H
+
+#include <tuple>
+#include <vector>
+#include "TreeEngine.h"
+
+// Scapegoat tree with alpha = 2/3: nodes hold nothing but the key and the
+// child pointers. An insert that lands deeper than log_{3/2}(size) rebuilds
+// the subtree of the lowest ancestor holding over 2/3 of its own subtree in
+// one child; erases rebuild the whole tree once a third of its peak size is
+// gone. Rebuilds relink the existing nodes and take linear time, as does
+// Build from sorted keys, which shares the code.
+//
+// Augment: see TreeEngine.h; Trace: see OperationTrace.h.
+template <typename T, typename Compare = std::less<T>, typename Augment = NoAugment, typename Trace = NoTrace>
+class ScapegoatTree : public BatchOperations<ScapegoatTree<T, Compare, Augment, Trace>, T> {
+ public:
+  using KeyType = T;
+  using AugmentData = typename Augment::Data;
+
+  class Node {
+    friend class ScapegoatTree;
+   public:
+    T value;
+
+    Node() = default;
+
+    Node(T value_) : value(value_) {}
+
+   private:
+    Node *left_ = nullptr, *right_ = nullptr;
+    [[no_unique_address]] AugmentData augment_;
+  };
+
+  ScapegoatTree() = default;
+
+  ScapegoatTree(const ScapegoatTree&) = delete;
+  ScapegoatTree& operator=(const ScapegoatTree&) = delete;
+
+  ~ScapegoatTree();
+
+  // Replaces the contents with the keys in [first, last), which must be
+  // sorted by Compare and distinct.
+  template <typename Iterator>
+  void Build(Iterator first, Iterator last);
+
+  void Insert(T value);
+
+  void Erase(T value);
+
+  Node* FindNode(T value);
+  bool Find(T value);
+
+  // Interleaves the lookups unless the engine records a trace.
+  size_t FindBatch(std::span<const T> keys, std::span<uint8_t> results);
+
+  void GetVisualizationData(VisualizationData<T> &data);
+
+  const TraceRecorder* GetTrace() const;
+
+  const Trace& GetTracePolicy() const;
+
+  TreeStats GetStats() const;
+
+  // Augment data of the whole tree.
+  AugmentData GetAugment() const;
+
+  bool InvariantCheck();
+
+ private:
+  Node *root_ = nullptr, *selected_ = nullptr;
+  // Number of keys, and its maximum since the last full rebuild.
+  size_t size_ = 0, max_size_ = 0;
+  [[no_unique_address]] Compare less_;
+  [[no_unique_address]] Trace trace_;
+  // Scratch space kept between operations: the ancestors of the node being
+  // inserted or erased, parents first, and the nodes of a rebuild in order.
+  std::vector<Node*> path_, nodes_, stack_;
+  std::vector<std::tuple<size_t, size_t, Node**>> ranges_;
+
+  void Clear();
+
+  // Deepest level an insert may reach without a rebuild.
+  static int MaxDepth(size_t size);
+
+  size_t CountNodes(Node *node);
+
+  // Rebalances the subtree of node, of the given size, and returns its root.
+  Node* Rebuild(Node *node, size_t size);
+
+  // Links nodes_ into a perfectly balanced tree and returns its root.
+  Node* BuildBalanced();
+
+  void UpdateAugment(Node *node);
+
+  void UpdatePath();
+};
+
+#endif // SCAPEGOATTREE_H
@@ -0,0 +1,100 @@
+#ifndef SPATIALGRID_IMPL
+#define SPATIALGRID_IMPL
+
+#include "SpatialGrid.h"
+#include <algorithm>
+#include <cmath>
+
+inline bool SpatialGrid::Box::Contains(double x, double y) const {
+  return left <= x && x <= right && top <= y && y <= bottom;
+}
+
+inline bool SpatialGrid::Box::Intersects(const Box &other) const {
+  return left <= other.right && other.left <= right &&
+         top <= other.bottom && other.top <= bottom;
+}
+
+inline void SpatialGrid::Clear() {
+  boxes_.clear();
+  bucket_begin_.clear();
+  items_.clear();
+}
+
+inline void SpatialGrid::Add(Box box) {
+  boxes_.push_back(box);
+}
+
+inline int64_t SpatialGrid::Cell(double coordinate, double size) const {
+  return int64_t(std::floor(coordinate / size));
+}
+
+inline int SpatialGrid::Bucket(int64_t cell_x, int64_t cell_y) const {
+  uint64_t hash = uint64_t(cell_x) * 0x9E3779B97F4A7C15ull ^ uint64_t(cell_y) * 0xC2B2AE3D27D4EB4Full;
+  return int((hash ^ (hash >> 29)) % uint64_t(bucket_begin_.size() - 1));
+}
+
+// A cell is as large as the largest box, so a box reaches at most one cell
+// beyond the cell of its center in every direction.
+inline void SpatialGrid::Build() {
+  cell_width_ = cell_height_ = 1;
+  for (const Box &box : boxes_) {
+    cell_width_ = std::max(cell_width_, box.right - box.left);
+    cell_height_ = std::max(cell_height_, box.bottom - box.top);
+  }
+  bucket_begin_.assign(boxes_.size() + 2, 0);
+  items_.resize(boxes_.size());
+  auto BucketOf = [&](const Box &box) {
+    return Bucket(Cell((box.left + box.right) / 2, cell_width_),
+                  Cell((box.top + box.bottom) / 2, cell_height_));
+  };
+  for (const Box &box : boxes_) {
+    ++bucket_begin_[BucketOf(box) + 1];
+  }
+  for (int i = 1; i < int(bucket_begin_.size()); i++) {
+    bucket_begin_[i] += bucket_begin_[i - 1];
+  }
+  // Counting sort into the buckets; bucket_begin_ ends up shifted back by one
+  // slot, which restores it to the bucket starts.
+  for (int i = 0; i < int(boxes_.size()); i++) {
+    items_[bucket_begin_[BucketOf(boxes_[i])]++] = i;
+  }
+  for (int i = int(bucket_begin_.size()) - 1; i > 0; i--) {
+    bucket_begin_[i] = bucket_begin_[i - 1];
+  }
+  bucket_begin_[0] = 0;
+}
+
+template <typename Callback>
+void SpatialGrid::Query(const Box &area, Callback callback) const {
+  if (boxes_.empty()) {
+    return;
+  }
+  int64_t x0 = Cell(area.left - cell_width_ / 2, cell_width_);
+  int64_t x1 = Cell(area.right + cell_width_ / 2, cell_width_);
+  int64_t y0 = Cell(area.top - cell_height_ / 2, cell_height_);
+  int64_t y1 = Cell(area.bottom + cell_height_ / 2, cell_height_);
+  for (int64_t cell_y = y0; cell_y <= y1; cell_y++) {
+    for (int64_t cell_x = x0; cell_x <= x1; cell_x++) {
+      int bucket = Bucket(cell_x, cell_y);
+      for (int k = bucket_begin_[bucket]; k < bucket_begin_[bucket + 1]; k++) {
+        const Box &box = boxes_[items_[k]];
+        // Other cells share the bucket, so check the cell as well.
+        if (Cell((box.left + box.right) / 2, cell_width_) == cell_x &&
+            Cell((box.top + box.bottom) / 2, cell_height_) == cell_y &&
+            box.Intersects(area)) {
+          callback(items_[k]);
+        }
+      }
+    }
+  }
+}
+
+inline int SpatialGrid::Find(double x, double y) const {
+  int result = -1;
+  Query(Box{x, y, x, y}, [&](int index) {
+    result = index;
+  });
+  return result;
+}
+
+#endif // SPATIALGRID_IMPL
@@ -0,0 +1,46 @@
+#ifndef SPATIALGRID_H
+#define SPATIALGRID_H
+
+#include <cstdint>
+#include <vector>
+
+// Spatial hash over axis-aligned boxes. Every box is stored in the cell of its
+// center and the cells are hashed into as many buckets as there are boxes, so
+// the index stays O(n) however sparse the drawing is (a degenerate tree is a
+// diagonal line of nodes).
+class SpatialGrid {
+ public:
+  struct Box {
+    double left, top, right, bottom;
+
+    bool Contains(double x, double y) const;
+
+    bool Intersects(const Box &other) const;
+  };
+
+  // Empties the index, keeping the capacity of its arrays.
+  void Clear();
+
+  void Add(Box box);
+
+  // Sorts the added boxes into buckets; call before any query.
+  void Build();
+
+  // Index of a box containing the point, or -1.
+  int Find(double x, double y) const;
+
+  // Calls callback(index) for every box intersecting the area.
+  template <typename Callback>
+  void Query(const Box &area, Callback callback) const;
+
+ private:
+  std::vector<Box> boxes_;
+  std::vector<int> bucket_begin_, items_;
+  double cell_width_ = 1, cell_height_ = 1;
+
+  int64_t Cell(double coordinate, double size) const;
+
+  int Bucket(int64_t cell_x, int64_t cell_y) const;
+};
+
+#endif // SPATIALGRID_H
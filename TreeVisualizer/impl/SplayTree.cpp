@@ -2,9 +2,32 @@
 #define SPLAYTREE_IMPL
 
 #include "SplayTree.h"
+#include <type_traits>
+#include <vector>
+#include <tuple>
+#include <algorithm>
 
-template <typename T>
-void SplayTree<T>::CutParent(Node* node) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+SplayTree<T, Compare, Augment, Trace>::~SplayTree() {
+  // Iterative, the tree may be a path of millions of nodes.
+  std::vector<Node*> stack;
+  if (root_ != nullptr) {
+    stack.push_back(root_);
+  }
+  while (!stack.empty()) {
+    Node *node = stack.back();
+    stack.pop_back();
+    for (Node *child : {node->left_, node->right_}) {
+      if (child != nullptr) {
+        stack.push_back(child);
+      }
+    }
+    delete node;
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void SplayTree<T, Compare, Augment, Trace>::CutParent(Node* node) {
   if (node && node->parent_) {
     if (node->parent_->left_ == node) {
       node->parent_->left_ = nullptr;
@@ -15,8 +38,8 @@ void SplayTree<T>::CutParent(Node* node) {
   }
 }
 
-template <typename T>
-void SplayTree<T>::LinkLeft(Node *node, Node *parent) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+void SplayTree<T, Compare, Augment, Trace>::LinkLeft(Node *node, Node *parent) {
   if (parent) {
     parent->left_ = node;
   }
@@ -25,8 +48,8 @@ void SplayTree<T>::LinkLeft(Node *node, Node *parent) {
   }
 }
 
-template <typename T>
-void SplayTree<T>::LinkRight(Node *node, Node *parent) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+void SplayTree<T, Compare, Augment, Trace>::LinkRight(Node *node, Node *parent) {
   if (parent) {
     parent->right_ = node;
   }
@@ -35,19 +58,31 @@ void SplayTree<T>::LinkRight(Node *node, Node *parent) {
   }
 }
 
-template <typename T>
-bool SplayTree<T>::IsLeft(Node *x) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+bool SplayTree<T, Compare, Augment, Trace>::IsLeft(Node *x) {
   return x && x->parent_ && x->parent_->left_ == x;
 }
 
-template <typename T>
-bool SplayTree<T>::IsRight(Node *x) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+bool SplayTree<T, Compare, Augment, Trace>::IsRight(Node *x) {
   return x && x->parent_ && x->parent_->right_ == x;
 }
 
-template <typename T>
-SplayTree<T>::Node* SplayTree<T>::RotateLeft(Node *x) {
+// Rotations keep the augment data up to date, and splaying a new leaf rotates
+// every one of its ancestors, so only the leaf itself needs an update.
+template <typename T, typename Compare, typename Augment, typename Trace>
+void SplayTree<T, Compare, Augment, Trace>::UpdateAugment(Node *x) {
+  if constexpr (Augment::kEnabled) {
+    const AugmentData *children[] = {x->left_ ? &x->left_->augment_ : nullptr,
+                                     x->right_ ? &x->right_->augment_ : nullptr};
+    Augment::template Update<T>(x->augment_, {&x->value, 1}, children);
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+SplayTree<T, Compare, Augment, Trace>::Node* SplayTree<T, Compare, Augment, Trace>::RotateLeft(Node *x) {
   Node *y = x->right_, *beta = y->left_, *parent = x->parent_;
+  trace_.Record(TraceEvent::kRotateLeft, x, y);
   bool is_left = IsLeft(x);
   CutParent(x), CutParent(y), CutParent(beta);
   if (is_left) {
@@ -59,12 +94,14 @@ SplayTree<T>::Node* SplayTree<T>::RotateLeft(Node *x) {
   if (root_ == x) {
     root_ = y;
   }
+  UpdateAugment(x), UpdateAugment(y);
   return y;
 }
 
-template <typename T>
-SplayTree<T>::Node* SplayTree<T>::RotateRight(Node *x) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+SplayTree<T, Compare, Augment, Trace>::Node* SplayTree<T, Compare, Augment, Trace>::RotateRight(Node *x) {
   Node *y = x->left_, *beta = y->right_, *parent = x->parent_;
+  trace_.Record(TraceEvent::kRotateRight, x, y);
   bool is_left = IsLeft(x);
   CutParent(x), CutParent(y), CutParent(beta);
   if (is_left) {
@@ -76,13 +113,15 @@ SplayTree<T>::Node* SplayTree<T>::RotateRight(Node *x) {
   if (root_ == x) {
     root_ = y;
   }
+  UpdateAugment(x), UpdateAugment(y);
   return y;
 }
 
-template <typename T>
-void SplayTree<T>::Splay(Node *node) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+void SplayTree<T, Compare, Augment, Trace>::Splay(Node *node) {
   while (node->parent_) {
     if (!node->parent_->parent_) {
+      trace_.Record(TraceEvent::kZig, node);
       if (IsLeft(node)) {
         RotateRight(node->parent_);
       } else {
@@ -91,17 +130,21 @@ void SplayTree<T>::Splay(Node *node) {
     } else {
       if (IsLeft(node)) {
         if (IsLeft(node->parent_)) {
+          trace_.Record(TraceEvent::kZigZig, node);
           RotateRight(node->parent_->parent_);
           RotateRight(node->parent_);
         } else {
+          trace_.Record(TraceEvent::kZigZag, node);
           RotateRight(node->parent_);
           RotateLeft(node->parent_);
         }
       } else {
         if (IsLeft(node->parent_)) {
+          trace_.Record(TraceEvent::kZigZag, node);
           RotateLeft(node->parent_);
           RotateRight(node->parent_); 
         } else {
+          trace_.Record(TraceEvent::kZigZig, node);
           RotateLeft(node->parent_->parent_);
           RotateLeft(node->parent_);
         }
@@ -110,55 +153,83 @@ void SplayTree<T>::Splay(Node *node) {
   }
 }
 
-template <typename T>
-void SplayTree<T>::Insert(T value) {
-  Node *current = root_;
+template <typename T, typename Compare, typename Augment, typename Trace>
+SplayTree<T, Compare, Augment, Trace>::Node* SplayTree<T, Compare, Augment, Trace>::Climb(Node *hint, T value) {
+  // Past the hint, the subtree of a node is bounded on that side by the
+  // first ancestor entered from the other side.
+  Node *node = hint;
+  if (less_(node->value, value)) {
+    while (IsRight(node) || (IsLeft(node) && !less_(value, node->parent_->value))) {
+      node = node->parent_;
+    }
+  } else if (less_(value, node->value)) {
+    while (IsLeft(node) || (IsRight(node) && !less_(node->parent_->value, value))) {
+      node = node->parent_;
+    }
+  }
+  return node;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void SplayTree<T, Compare, Augment, Trace>::Insert(T value) {
+  Insert(nullptr, value);
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+SplayTree<T, Compare, Augment, Trace>::Node* SplayTree<T, Compare, Augment, Trace>::Insert(Node *hint, T value) {
+  trace_.Record(TraceEvent::kInsert, nullptr);
+  Node *current = hint != nullptr ? Climb(hint, value) : root_;
   Node *parent = nullptr;
   bool is_left = false;
   while (current) {
-    if (value < current->value) {
+    trace_.Record(TraceEvent::kVisit, current);
+    if (less_(value, current->value)) {
       parent = current;
       current = current->left_;
       is_left = true;
-    } else if (value == current->value) {
-      return;
-    } else {
+    } else if (less_(current->value, value)) {
       parent = current;
       current = current->right_;
       is_left = false;
+    } else {
+      return current;
     }
   }
   if (parent == nullptr) {
     root_ = new Node(value);
+    UpdateAugment(root_);
+    return root_;
+  }
+  current = new Node(value);
+  UpdateAugment(current);
+  if (is_left) {
+    LinkLeft(current, parent);
   } else {
-    current = new Node(value);
-    if (is_left) {
-      LinkLeft(current, parent);
-    } else {
-      LinkRight(current, parent);
-    }
-    Splay(current);
+    LinkRight(current, parent);
   }
+  Splay(current);
+  return current;
 }
 
-template <typename T>
-SplayTree<T>::Node* SplayTree<T>::FindNode(T value) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+SplayTree<T, Compare, Augment, Trace>::Node* SplayTree<T, Compare, Augment, Trace>::FindNode(T value) {
   Node *current = root_;
   while (current) {
-    if (value < current->value) {
+    trace_.Record(TraceEvent::kVisit, current);
+    if (less_(value, current->value)) {
       current = current->left_;
-    } else if (value == current->value) {
+    } else if (less_(current->value, value)) {
+      current = current->right_;
+    } else {
       Splay(current);
       return root_;
-    } else {
-      current = current->right_;
     }
   }
   return current;
 }
 
-template <typename T>
-void SplayTree<T>::Erase(Node *node) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+void SplayTree<T, Compare, Augment, Trace>::Erase(Node *node) {
   Splay(node);
   Node *left = node->left_, *right = node->right_;
   CutParent(node->left_);
@@ -167,8 +238,8 @@ void SplayTree<T>::Erase(Node *node) {
   root_ = Merge(left, right);
 }
 
-template <typename T>
-SplayTree<T>::Node* SplayTree<T>::Merge(Node *a, Node *b) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+SplayTree<T, Compare, Augment, Trace>::Node* SplayTree<T, Compare, Augment, Trace>::Merge(Node *a, Node *b) {
   if (a == nullptr) {
     return b;
   }
@@ -181,42 +252,92 @@ SplayTree<T>::Node* SplayTree<T>::Merge(Node *a, Node *b) {
   }
   Splay(max_node_a);
   LinkRight(b, max_node_a);
+  UpdateAugment(max_node_a);
   return max_node_a;
 }
 
-template <typename T>
-bool SplayTree<T>::Find(T value) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+bool SplayTree<T, Compare, Augment, Trace>::Find(T value) {
+  trace_.Record(TraceEvent::kFind, nullptr);
   selected_ = FindNode(value);
   return selected_ != nullptr;
 }
 
-template <typename T>
-void SplayTree<T>::Erase(T value) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+void SplayTree<T, Compare, Augment, Trace>::Erase(T value) {
+  trace_.Record(TraceEvent::kErase, nullptr);
   Node *node = FindNode(value);
   if (node != nullptr) {
     Erase(node);
   }
 }
 
-template <typename T>
-VisualizationData* SplayTree<T>::GetVisualizationData() {
-  auto DFS = [&](auto&& self, Node *node) -> VisualizationData* {
-    if (node == nullptr) {
-      return nullptr;
+template <typename T, typename Compare, typename Augment, typename Trace>
+void SplayTree<T, Compare, Augment, Trace>::GetVisualizationData(VisualizationData<T> &data) {
+  data.Clear();
+  // Preorder with an explicit stack: node, index of its parent, child slot.
+  std::vector<std::tuple<Node*, int, int>> stack;
+  if (root_ != nullptr) {
+    stack.emplace_back(root_, -1, 0);
+  }
+  while (!stack.empty()) {
+    auto [node, parent, slot] = stack.back();
+    stack.pop_back();
+    int index = data.AddNode(reinterpret_cast<uintptr_t>(node), 2);
+    data.AddKey(node->value, VisualizationData<T>::kPlain, node == selected_);
+    if (parent != -1) {
+      data.SetChild(parent, slot, index);
     }
-    VisualizationData *data = new VisualizationData();
-    data->keys.push_back(std::to_string(node->value));
-    if (node != selected_) {
-      data->colors.push_back({QColor("#CDCDCE"), QColor(Qt::black)});
-    } else {
-      data->colors.push_back({QColor(Qt::green), QColor(Qt::white)});
+    if (node->right_ != nullptr) {
+      stack.emplace_back(node->right_, index, 1);
+    }
+    if (node->left_ != nullptr) {
+      stack.emplace_back(node->left_, index, 0);
     }
-    data->children = {self(self, node->left_), self(self, node->right_)};
-    return data;
-  };
-  VisualizationData* data = DFS(DFS, root_);
+  }
   selected_ = nullptr;
-  return data;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+const TraceRecorder* SplayTree<T, Compare, Augment, Trace>::GetTrace() const {
+  if constexpr (std::is_same_v<Trace, TraceRecorder>) {
+    return &trace_;
+  } else {
+    return nullptr;
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+const Trace& SplayTree<T, Compare, Augment, Trace>::GetTracePolicy() const {
+  return trace_;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+TreeStats SplayTree<T, Compare, Augment, Trace>::GetStats() const {
+  TreeStats stats;
+  std::vector<std::pair<Node*, int>> stack;
+  if (root_ != nullptr) {
+    stack.emplace_back(root_, 1);
+  }
+  while (!stack.empty()) {
+    auto [node, depth] = stack.back();
+    stack.pop_back();
+    stats.keys++;
+    stats.height = std::max(stats.height, depth);
+    for (Node *child : {node->left_, node->right_}) {
+      if (child != nullptr) {
+        stack.emplace_back(child, depth + 1);
+      }
+    }
+  }
+  stats.nodes = stats.keys;
+  stats.bytes = stats.nodes * sizeof(Node);
+  return stats;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+SplayTree<T, Compare, Augment, Trace>::AugmentData SplayTree<T, Compare, Augment, Trace>::GetAugment() const {
+  return root_ != nullptr ? root_->augment_ : AugmentData();
 }
 
 #endif // SPLAYTREE_IMPL
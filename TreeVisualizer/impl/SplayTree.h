@@ -2,11 +2,15 @@
 #define SPLAYTREE_H
 
 #include <tuple>
-#include "Visualization.h"
+#include "TreeEngine.h"
 
-template <typename T>
-class SplayTree : public VisualizableTree<T> {
+// Augment: see TreeEngine.h; Trace: see OperationTrace.h.
+template <typename T, typename Compare = std::less<T>, typename Augment = NoAugment, typename Trace = NoTrace>
+class SplayTree : public BatchOperations<SplayTree<T, Compare, Augment, Trace>, T> {
  public:
+  using KeyType = T;
+  using AugmentData = typename Augment::Data;
+
   class Node {
     friend class SplayTree;
    public:
@@ -19,22 +23,49 @@ class SplayTree : public VisualizableTree<T> {
    private:
     Node *left_ = nullptr, *right_ = nullptr;
     Node *parent_ = nullptr;
+    [[no_unique_address]] AugmentData augment_;
   };
 
+  SplayTree() = default;
+
+  SplayTree(const SplayTree&) = delete;
+  SplayTree& operator=(const SplayTree&) = delete;
+
+  ~SplayTree();
+
   Node* Merge(Node *a, Node *b);
 
-  void Insert(T value) override;
+  // Splaying leaves the last inserted key at the root, where the next key of
+  // a sorted run is linked at once.
+  void Insert(T value);
+
+  // Searches from hint, a node of this tree or nullptr for the root: goes up
+  // only until an ancestor bounds value, then down. Returns the node of
+  // value, splayed if new.
+  Node* Insert(Node *hint, T value);
 
   Node* FindNode(T value);
-  bool Find(T value) override;
+  // Lookups splay, so FindBatch runs them one by one.
+  bool Find(T value);
 
   void Erase(Node *node);
-  void Erase(T value) override;
+  void Erase(T value);
+
+  void GetVisualizationData(VisualizationData<T> &data);
 
-  VisualizationData* GetVisualizationData() override;
+  const TraceRecorder* GetTrace() const;
+
+  const Trace& GetTracePolicy() const;
+
+  TreeStats GetStats() const;
+
+  // Augment data of the whole tree.
+  AugmentData GetAugment() const;
 
  private:
   Node *root_ = nullptr, *selected_ = nullptr;
+  [[no_unique_address]] Compare less_;
+  [[no_unique_address]] Trace trace_;
 
   void CutParent(Node *node);
 
@@ -42,12 +73,17 @@ class SplayTree : public VisualizableTree<T> {
 
   void LinkRight(Node *node, Node *parent);
 
-  SplayTree<T>::Node* RotateLeft(Node *node);
+  void UpdateAugment(Node *node);
 
-  SplayTree<T>::Node* RotateRight(Node *node);
+  SplayTree<T, Compare, Augment, Trace>::Node* RotateLeft(Node *node);
+
+  SplayTree<T, Compare, Augment, Trace>::Node* RotateRight(Node *node);
 
   void Splay(Node *node);
 
+  // Lowest ancestor of hint whose subtree may hold value.
+  Node* Climb(Node *hint, T value);
+
   bool IsLeft(Node *node);
 
   bool IsRight(Node *node);
@@ -0,0 +1,187 @@
+#ifndef SVGEXPORT_IMPL
+#define SVGEXPORT_IMPL
+
+#include "SvgExport.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <ios>
+#include <sstream>
+
+// Palette of TreeItem: fill and label of every color class, then of the
+// selected key.
+constexpr const char *kSvgStyle =
+    "<style>"
+    "line,rect{stroke:#000}"
+    "text{text-anchor:middle;dominant-baseline:central}"
+    ".c0{fill:#CDCDCE}.c1{fill:#F00}.c2{fill:#000}.c3{fill:#0F0}"
+    ".t0{fill:#000}.t1,.t2,.t3{fill:#FFF}"
+    "</style>\n";
+constexpr int kSvgSelectedColor = 3;
+
+inline double SvgExporter::KeyWidth(int key) const {
+  int digits = 1;
+  for (int64_t rest = std::abs(int64_t(key)); rest >= 10; rest /= 10) {
+    digits++;
+  }
+  return (digits + (key < 0)) * char_width + 2 * padding;
+}
+
+inline double SvgExporter::KeyHeight() const {
+  return std::ceil(font_size * 1.25) + 2 * padding;
+}
+
+inline void SvgExporter::Layout(const VisualizationData<int> &data) {
+  data_ = &data;
+  int n = data.Size();
+  shape_.child_begin = data.child_begin;
+  shape_.children = data.children;
+  shape_.widths.assign(n, 0);
+  shape_.heights.assign(n, KeyHeight());
+  for (int v = 0; v < n; v++) {
+    for (int k = data.key_begin[v]; k < data.key_begin[v + 1]; k++) {
+      shape_.widths[v] += KeyWidth(data.keys[k]);
+    }
+  }
+  layout_.level_gap = level_gap;
+  layout_.sibling_gap = sibling_gap;
+  bounds_.resize(n);
+  if (n == 0) {
+    layout_.width = layout_.height = 0;
+    return;
+  }
+  layout_.Compute(shape_);
+  // Children come after their parents, so a reverse sweep sees complete
+  // subtrees. The edge from the parent ends on top of the node, within them.
+  for (int v = n - 1; v >= 0; v--) {
+    SpatialGrid::Box &box = bounds_[v];
+    box = {layout_.x[v], layout_.y[v], layout_.x[v] + shape_.widths[v], layout_.y[v] + KeyHeight()};
+    for (int k = data.child_begin[v]; k < data.child_begin[v + 1]; k++) {
+      if (int child = data.children[k]; child != -1) {
+        box.left = std::min(box.left, bounds_[child].left);
+        box.right = std::max(box.right, bounds_[child].right);
+        box.bottom = std::max(box.bottom, bounds_[child].bottom);
+      }
+    }
+  }
+}
+
+inline double SvgExporter::Width() const {
+  return layout_.width;
+}
+
+inline double SvgExporter::Height() const {
+  return layout_.height;
+}
+
+inline void SvgExporter::WriteHeader(std::ostream &out, const SpatialGrid::Box &view) const {
+  double width = view.right - view.left, height = view.bottom - view.top;
+  out << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" << width << "\" height=\"" << height
+      << "\" viewBox=\"" << view.left << ' ' << view.top << ' ' << width << ' ' << height
+      << "\" font-family=\"monospace\" font-size=\"" << font_size << "\">\n" << kSvgStyle;
+}
+
+inline int SvgExporter::WriteArea(std::ostream &out, const SpatialGrid::Box &area) {
+  const VisualizationData<int> &data = *data_;
+  int written = 0;
+  double height = KeyHeight();
+  stack_.clear();
+  if (!bounds_.empty() && bounds_[0].Intersects(area)) {
+    stack_.push_back(0);
+  }
+  while (!stack_.empty()) {
+    int v = stack_.back();
+    stack_.pop_back();
+    double x = layout_.x[v], y = layout_.y[v];
+    int first_key = data.key_begin[v], key_count = data.key_begin[v + 1] - first_key;
+    if (SpatialGrid::Box{x, y, x + shape_.widths[v], y + height}.Intersects(area)) {
+      written++;
+      double left = x;
+      for (int k = first_key; k < first_key + key_count; k++) {
+        double width = KeyWidth(data.keys[k]);
+        int color = data.selected[k] ? kSvgSelectedColor : data.colors[k];
+        out << "<rect x=\"" << left << "\" y=\"" << y << "\" width=\"" << width << "\" height=\"" << height
+            << "\" class=\"c" << color << "\"/><text x=\"" << left + width / 2 << "\" y=\"" << y + height / 2
+            << "\" class=\"t" << color << "\">" << data.keys[k] << "</text>\n";
+        left += width;
+      }
+    }
+    // Edges leave from the boundary between the keys around the child.
+    double anchor_x = x;
+    for (int k = data.child_begin[v]; k < data.child_begin[v + 1]; k++) {
+      int slot = k - data.child_begin[v];
+      if (slot > 0 && slot <= key_count) {
+        anchor_x += KeyWidth(data.keys[first_key + slot - 1]);
+      }
+      int child = data.children[k];
+      if (child == -1) {
+        continue;
+      }
+      double child_x = layout_.x[child] + shape_.widths[child] / 2, child_y = layout_.y[child];
+      SpatialGrid::Box edge{std::min(anchor_x, child_x), y + height, std::max(anchor_x, child_x), child_y};
+      if (edge.Intersects(area)) {
+        written++;
+        out << "<line x1=\"" << anchor_x << "\" y1=\"" << y + height << "\" x2=\"" << child_x << "\" y2=\""
+            << child_y << "\"/>\n";
+      }
+    }
+    // Pushed in reverse, so that the leftmost subtree is written first.
+    for (int k = data.child_begin[v + 1] - 1; k >= data.child_begin[v]; k--) {
+      if (int child = data.children[k]; child != -1 && bounds_[child].Intersects(area)) {
+        stack_.push_back(child);
+      }
+    }
+  }
+  return written;
+}
+
+inline bool SvgExporter::Write(std::ostream &out) {
+  std::ios format(nullptr);
+  format.copyfmt(out);
+  out << std::fixed << std::setprecision(1);
+  SpatialGrid::Box view{0, 0, Width(), Height()};
+  WriteHeader(out, view);
+  WriteArea(out, view);
+  out << "</svg>\n";
+  out.copyfmt(format);
+  return bool(out);
+}
+
+inline int SvgExporter::WriteTile(std::ostream &out, int column, int row, double tile_size) {
+  std::ios format(nullptr);
+  format.copyfmt(out);
+  out << std::fixed << std::setprecision(1);
+  SpatialGrid::Box view{column * tile_size, row * tile_size, (column + 1) * tile_size, (row + 1) * tile_size};
+  WriteHeader(out, view);
+  int written = WriteArea(out, view);
+  out << "</svg>\n";
+  out.copyfmt(format);
+  return written;
+}
+
+inline int SvgExporter::WriteTiles(const std::string &prefix, double tile_size) {
+  int columns = std::max(1, int(std::ceil(Width() / tile_size)));
+  int rows = std::max(1, int(std::ceil(Height() / tile_size)));
+  int files = 0;
+  // A tile is kept in memory until it is known not to be empty.
+  std::ostringstream tile;
+  for (int row = 0; row < rows; row++) {
+    for (int column = 0; column < columns; column++) {
+      tile.str("");
+      if (WriteTile(tile, column, row, tile_size) == 0) {
+        continue;
+      }
+      std::ofstream out(prefix + "_" + std::to_string(row) + "_" + std::to_string(column) + ".svg");
+      out << tile.view();
+      if (!out) {
+        return -1;
+      }
+      files++;
+    }
+  }
+  return files;
+}
+
+#endif // SVGEXPORT_IMPL
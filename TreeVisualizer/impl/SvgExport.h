@@ -0,0 +1,59 @@
+#ifndef SVGEXPORT_H
+#define SVGEXPORT_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include "VisualizableTree.h"
+#include "TreeLayout.h"
+#include "SpatialGrid.h"
+
+// Draws a snapshot of a tree as SVG without Qt, in the colors of TreeItem:
+// as one document, or as a grid of tiles for drawings too large to open at
+// once. Nodes are written depth-first straight to the stream and a tile only
+// walks the subtrees that reach into it, so memory stays that of the layout
+// however large the output.
+class SvgExporter {
+ public:
+  // Labels are monospace; char_width is the advance of a digit.
+  double font_size = 13, char_width = 8;
+  // Around every label, and between levels and subtrees as in the GUI.
+  double padding = 14, level_gap = 30, sibling_gap = 50;
+
+  // Lays out data, which is read again by the writes and must outlive them.
+  void Layout(const VisualizationData<int> &data);
+
+  double Width() const;
+
+  double Height() const;
+
+  // Writes the whole drawing; false on a stream error.
+  bool Write(std::ostream &out);
+
+  // Writes the square tile at column, row of the grid of tile_size pixels
+  // as a document of its own. Returns the number of nodes and edges in it.
+  int WriteTile(std::ostream &out, int column, int row, double tile_size);
+
+  // Writes the tiles that are not empty to prefix_ROW_COLUMN.svg and
+  // returns their number, or -1 if a file could not be written.
+  int WriteTiles(const std::string &prefix, double tile_size);
+
+ private:
+  const VisualizationData<int> *data_ = nullptr;
+  TreeShape shape_;
+  TreeLayout layout_;
+  // Per node: bounds of the subtree, edge included.
+  std::vector<SpatialGrid::Box> bounds_;
+  std::vector<int> stack_;
+
+  double KeyWidth(int key) const;
+
+  double KeyHeight() const;
+
+  void WriteHeader(std::ostream &out, const SpatialGrid::Box &view) const;
+
+  // Nodes and edges intersecting area, depth-first; returns their number.
+  int WriteArea(std::ostream &out, const SpatialGrid::Box &area);
+};
+
+#endif // SVGEXPORT_H
@@ -2,98 +2,235 @@
 #define TREAP_IMPL
 
 #include "Treap.h"
+#include <type_traits>
+#include <vector>
+#include <tuple>
+#include <utility>
+#include <algorithm>
 
-template <typename T>
-std::pair<typename Treap<T>::Node*, typename Treap<T>::Node*> Treap<T>::Split(Node* node, T key) {
-  if (node == nullptr) {
-    return {nullptr, nullptr};
+template <typename T, typename Compare, typename Augment, typename Trace>
+Treap<T, Compare, Augment, Trace>::~Treap() {
+  // Iterative, the tree may be a path of millions of nodes.
+  std::vector<Node*> stack;
+  if (root_ != nullptr) {
+    stack.push_back(root_);
   }
-  if (node->value >= key) {
-    auto [L, R] = Split(node->left_, key);
-    node->left_ = R;
-    return {L, node};
-  } else {
-    auto [L, R] = Split(node->right_, key);
-    node->right_ = L;
-    return {node, R};
+  while (!stack.empty()) {
+    Node *node = stack.back();
+    stack.pop_back();
+    for (Node *child : {node->left_, node->right_}) {
+      if (child != nullptr) {
+        stack.push_back(child);
+      }
+    }
+    delete node;
   }
 }
 
-template <typename T>
-Treap<T>::Node* Treap<T>::Merge(Node *a, Node *b) {
-  if (a == nullptr) {
-    return b;
+template <typename T, typename Compare, typename Augment, typename Trace>
+void Treap<T, Compare, Augment, Trace>::UpdateAugment(Node *x) {
+  if constexpr (Augment::kEnabled) {
+    const AugmentData *children[] = {x->left_ ? &x->left_->augment_ : nullptr,
+                                     x->right_ ? &x->right_->augment_ : nullptr};
+    Augment::template Update<T>(x->augment_, {&x->value, 1}, children);
   }
-  if (b == nullptr) {
-    return a;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void Treap<T, Compare, Augment, Trace>::UpdatePath() {
+  if constexpr (Augment::kEnabled) {
+    for (auto it = path_.rbegin(); it != path_.rend(); ++it) {
+      UpdateAugment(*it);
+    }
+    path_.clear();
   }
-  if (a->priority_ > b->priority_) {
-    a->right_ = Merge(a->right_, b);
-    return a;
-  } else {
-    b->left_ = Merge(a, b->left_);
-    return b;
+}
+
+// Both splitting and merging walk down a single path. The nodes met are
+// appended to the result through the pointer to the link that is still
+// open, so no recursion is needed.
+template <typename T, typename Compare, typename Augment, typename Trace>
+std::pair<typename Treap<T, Compare, Augment, Trace>::Node*, typename Treap<T, Compare, Augment, Trace>::Node*> Treap<T, Compare, Augment, Trace>::Split(Node* node, T key, bool key_left) {
+  Node *left = nullptr, *right = nullptr;
+  Node **left_link = &left, **right_link = &right;
+  while (node != nullptr) {
+    trace_.Record(TraceEvent::kSplit, node);
+    if constexpr (Augment::kEnabled) {
+      path_.push_back(node);
+    }
+    if (key_left ? less_(key, node->value) : !less_(node->value, key)) {
+      *right_link = node;
+      right_link = &node->left_;
+      node = node->left_;
+    } else {
+      *left_link = node;
+      left_link = &node->right_;
+      node = node->right_;
+    }
   }
+  *left_link = *right_link = nullptr;
+  UpdatePath();
+  return {left, right};
 }
 
-template <typename T>
-void Treap<T>::Insert(T key) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+Treap<T, Compare, Augment, Trace>::Node* Treap<T, Compare, Augment, Trace>::Merge(Node *a, Node *b) {
+  Node *root = nullptr;
+  Node **link = &root;
+  while (a != nullptr && b != nullptr) {
+    trace_.Record(TraceEvent::kMerge, a, b);
+    if constexpr (Augment::kEnabled) {
+      path_.push_back(a->priority_ > b->priority_ ? a : b);
+    }
+    if (a->priority_ > b->priority_) {
+      *link = a;
+      link = &a->right_;
+      a = a->right_;
+    } else {
+      *link = b;
+      link = &b->left_;
+      b = b->left_;
+    }
+  }
+  *link = a != nullptr ? a : b;
+  UpdatePath();
+  return root;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void Treap<T, Compare, Augment, Trace>::Insert(T key) {
+  trace_.Record(TraceEvent::kInsert, nullptr);
   if (FindNode(key) != nullptr) {
     return;
   }
   auto [L, R] = Split(root_, key);
-  root_ = Merge(L, Merge(new Node(key), R));
+  Node *node = new Node(key, rng_());
+  UpdateAugment(node);
+  root_ = Merge(L, Merge(node, R));
 }
 
-template <typename T>
-void Treap<T>::Erase(T key) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+void Treap<T, Compare, Augment, Trace>::Erase(T key) {
+  trace_.Record(TraceEvent::kErase, nullptr);
   auto [L1, R1] = Split(root_, key);
-  auto [L2, R2] = Split(R1, key + 1);
+  auto [L2, R2] = Split(R1, key, true);
   delete L2;
   root_ = Merge(L1, R2); 
 }
 
-template <typename T>
-Treap<T>::Node* Treap<T>::FindNode(T key) {
-  Treap<T>::Node* current = root_;
+template <typename T, typename Compare, typename Augment, typename Trace>
+Treap<T, Compare, Augment, Trace>::Node* Treap<T, Compare, Augment, Trace>::FindNode(T key) {
+  Treap<T, Compare, Augment, Trace>::Node* current = root_;
   while (current != nullptr) {
-    if (key < current->value) {
+    trace_.Record(TraceEvent::kVisit, current);
+    if (less_(key, current->value)) {
       current = current->left_;
-    } else if (key == current->value) {
+    } else if (less_(current->value, key)) {
+      current = current->right_;
+    } else {
       selected_ = current;
       return current;
-    } else {
-      current = current->right_;
     }
   }
   return current;
 }
 
-template <typename T>
-bool Treap<T>::Find(T key) {
+template <typename T, typename Compare, typename Augment, typename Trace>
+bool Treap<T, Compare, Augment, Trace>::Find(T key) {
+  trace_.Record(TraceEvent::kFind, nullptr);
   selected_ = FindNode(key);
   return selected_ != nullptr;
 }
 
-template <typename T>
-VisualizationData* Treap<T>::GetVisualizationData() {
-  auto DFS = [&](auto&& self, Node *node) -> VisualizationData* {
-    if (node == nullptr) {
-      return nullptr;
+template <typename T, typename Compare, typename Augment, typename Trace>
+size_t Treap<T, Compare, Augment, Trace>::FindBatch(std::span<const T> keys, std::span<uint8_t> results) {
+  if constexpr (Trace::kEnabled) {
+    // One by one, so that the events of every lookup stay together.
+    return BatchOperations<Treap, T>::FindBatch(keys, results);
+  } else {
+    return InterleaveLookups(keys, results, root_, [this](Node *&node, const T &key) {
+      using Step = std::pair<BatchStep, const void*>;
+      if (node == nullptr) {
+        return Step(BatchStep::kMissing, nullptr);
+      }
+      if (less_(key, node->value)) {
+        node = node->left_;
+      } else if (less_(node->value, key)) {
+        node = node->right_;
+      } else {
+        return Step(BatchStep::kFound, nullptr);
+      }
+      return Step(BatchStep::kPending, node);
+    });
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void Treap<T, Compare, Augment, Trace>::GetVisualizationData(VisualizationData<T> &data) {
+  data.Clear();
+  // Preorder with an explicit stack: node, index of its parent, child slot.
+  std::vector<std::tuple<Node*, int, int>> stack;
+  if (root_ != nullptr) {
+    stack.emplace_back(root_, -1, 0);
+  }
+  while (!stack.empty()) {
+    auto [node, parent, slot] = stack.back();
+    stack.pop_back();
+    int index = data.AddNode(reinterpret_cast<uintptr_t>(node), 2);
+    data.AddKey(node->value, VisualizationData<T>::kPlain, node == selected_);
+    if (parent != -1) {
+      data.SetChild(parent, slot, index);
     }
-    VisualizationData *data = new VisualizationData();
-    data->keys.push_back(std::to_string(node->value));
-    if (node != selected_) {
-      data->colors.push_back({QColor("#CDCDCE"), QColor(Qt::black)});
-    } else {
-      data->colors.push_back({QColor(Qt::green), QColor(Qt::white)});
+    if (node->right_ != nullptr) {
+      stack.emplace_back(node->right_, index, 1);
     }
-    data->children = {self(self, node->left_), self(self, node->right_)};
-    return data;
-  };
-  VisualizationData* data = DFS(DFS, root_);
+    if (node->left_ != nullptr) {
+      stack.emplace_back(node->left_, index, 0);
+    }
+  }
   selected_ = nullptr;
-  return data;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+const TraceRecorder* Treap<T, Compare, Augment, Trace>::GetTrace() const {
+  if constexpr (std::is_same_v<Trace, TraceRecorder>) {
+    return &trace_;
+  } else {
+    return nullptr;
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+const Trace& Treap<T, Compare, Augment, Trace>::GetTracePolicy() const {
+  return trace_;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+TreeStats Treap<T, Compare, Augment, Trace>::GetStats() const {
+  TreeStats stats;
+  std::vector<std::pair<Node*, int>> stack;
+  if (root_ != nullptr) {
+    stack.emplace_back(root_, 1);
+  }
+  while (!stack.empty()) {
+    auto [node, depth] = stack.back();
+    stack.pop_back();
+    stats.keys++;
+    stats.height = std::max(stats.height, depth);
+    for (Node *child : {node->left_, node->right_}) {
+      if (child != nullptr) {
+        stack.emplace_back(child, depth + 1);
+      }
+    }
+  }
+  stats.nodes = stats.keys;
+  stats.bytes = stats.nodes * sizeof(Node);
+  return stats;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+Treap<T, Compare, Augment, Trace>::AugmentData Treap<T, Compare, Augment, Trace>::GetAugment() const {
+  return root_ != nullptr ? root_->augment_ : AugmentData();
 }
 
 #endif // TREAP_IMPL
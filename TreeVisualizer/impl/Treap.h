@@ -4,11 +4,16 @@
 #include <random>
 #include <chrono>
 #include <tuple>
-#include "Visualization.h"
+#include <vector>
+#include "TreeEngine.h"
 
-template <typename T>
-class Treap : public VisualizableTree<T> {
+// Augment: see TreeEngine.h; Trace: see OperationTrace.h.
+template <typename T, typename Compare = std::less<T>, typename Augment = NoAugment, typename Trace = NoTrace>
+class Treap : public BatchOperations<Treap<T, Compare, Augment, Trace>, T> {
  public:
+  using KeyType = T;
+  using AugmentData = typename Augment::Data;
+
   class Node {
     friend class Treap;
    public:
@@ -16,34 +21,62 @@ class Treap : public VisualizableTree<T> {
 
     Node() = default;
 
-    Node(T value_) : value(value_) {
-      static std::mt19937_64 rng(std::chrono::steady_clock::now().time_since_epoch().count());
-      priority_ = rng();
-    }
+    Node(T value_, uint64_t priority) : value(value_), priority_(priority) {}
 
    private:
     Node *left_ = nullptr, *right_ = nullptr;
     uint64_t priority_;
+    [[no_unique_address]] AugmentData augment_;
   };
 
   Treap() = default;
 
-  std::pair<Node*, Node*> Split(Node *node, T key);
+  Treap(const Treap&) = delete;
+  Treap& operator=(const Treap&) = delete;
+
+  ~Treap();
+
+  // Splits into the keys before key and the rest; with key_left set, key
+  // itself goes to the left part.
+  std::pair<Node*, Node*> Split(Node *node, T key, bool key_left = false);
 
   Node* Merge(Node *a, Node *b);
 
-  void Insert(T key) override;
+  void Insert(T key);
 
   Node* FindNode(T key);
 
-  bool Find(T key) override;
+  bool Find(T key);
+
+  // Interleaves the lookups unless the engine records a trace.
+  size_t FindBatch(std::span<const T> keys, std::span<uint8_t> results);
+
+  void Erase(T key);
 
-  void Erase(T key) override;
+  void GetVisualizationData(VisualizationData<T> &data);
 
-  VisualizationData* GetVisualizationData() override;
+  const TraceRecorder* GetTrace() const;
+
+  const Trace& GetTracePolicy() const;
+
+  TreeStats GetStats() const;
+
+  // Augment data of the whole tree.
+  AugmentData GetAugment() const;
 
  private:
   Node *root_ = nullptr, *selected_ = nullptr;
+  [[no_unique_address]] Compare less_;
+  [[no_unique_address]] Trace trace_;
+  // Nodes whose children a split or merge changed, parents first.
+  std::vector<Node*> path_;
+  // Priorities of new nodes; per tree, so that trees on different threads
+  // share no state.
+  std::mt19937_64 rng_{uint64_t(std::chrono::steady_clock::now().time_since_epoch().count())};
+
+  void UpdateAugment(Node *node);
+
+  void UpdatePath();
 };
 
 #endif // TREAP_H
@@ -0,0 +1,144 @@
+#ifndef TREEENGINE_IMPL
+#define TREEENGINE_IMPL
+
+#include "TreeEngine.h"
+#include <utility>
+
+template <typename T>
+void NoAugment::Update(Data&, std::span<const T>, std::span<const Data* const>) {}
+
+template <typename T>
+void SubtreeSize::Update(Data &data, std::span<const T> keys, std::span<const Data* const> children) {
+  data.size = keys.size();
+  for (const Data *child : children) {
+    if (child != nullptr) {
+      data.size += child->size;
+    }
+  }
+}
+
+template <typename Derived, typename T>
+Derived& BatchOperations<Derived, T>::Self() {
+  return static_cast<Derived&>(*this);
+}
+
+template <typename Derived, typename T>
+template <typename Iterator>
+void BatchOperations<Derived, T>::InsertAll(Iterator first, Iterator last) {
+  for (; first != last; ++first) {
+    Self().Insert(*first);
+  }
+}
+
+template <typename Derived, typename T>
+template <typename Iterator>
+void BatchOperations<Derived, T>::EraseAll(Iterator first, Iterator last) {
+  for (; first != last; ++first) {
+    Self().Erase(*first);
+  }
+}
+
+template <typename Derived, typename T>
+template <typename Iterator>
+size_t BatchOperations<Derived, T>::CountFound(Iterator first, Iterator last) {
+  size_t found = 0;
+  for (; first != last; ++first) {
+    found += Self().Find(*first);
+  }
+  return found;
+}
+
+template <typename Derived, typename T>
+size_t BatchOperations<Derived, T>::FindBatch(std::span<const T> keys, std::span<uint8_t> results) {
+  size_t found = 0;
+  for (size_t i = 0; i < keys.size(); i++) {
+    results[i] = Self().Find(keys[i]);
+    found += results[i];
+  }
+  return found;
+}
+
+inline void Prefetch(const void *address) {
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(address);
+#else
+  (void)address;
+#endif
+}
+
+// The window is a bit above the number of misses a core keeps in flight.
+template <typename T, typename Cursor, typename Step>
+size_t InterleaveLookups(std::span<const T> keys, std::span<uint8_t> results, Cursor start, Step step) {
+  constexpr int kWindow = 16;
+  struct Lookup {
+    Cursor cursor;
+    size_t index;
+  };
+  Lookup window[kWindow];
+  int active = 0;
+  size_t next = 0, found = 0;
+  while (active < kWindow && next < keys.size()) {
+    window[active++] = {start, next++};
+  }
+  while (active > 0) {
+    for (int i = 0; i < active;) {
+      Lookup &lookup = window[i];
+      auto [state, address] = step(lookup.cursor, keys[lookup.index]);
+      if (state == BatchStep::kPending) {
+        Prefetch(address);
+        i++;
+        continue;
+      }
+      results[lookup.index] = state == BatchStep::kFound;
+      found += state == BatchStep::kFound;
+      if (next < keys.size()) {
+        lookup = {start, next++};
+        i++;
+      } else {
+        lookup = window[--active];
+      }
+    }
+  }
+  return found;
+}
+
+template <TreeEngine Engine>
+template <typename... Args>
+TreeAdapter<Engine>::TreeAdapter(Args&&... args) : engine(std::forward<Args>(args)...) {}
+
+template <TreeEngine Engine>
+void TreeAdapter<Engine>::Insert(T value) {
+  engine.Insert(value);
+}
+
+template <TreeEngine Engine>
+void TreeAdapter<Engine>::Erase(T value) {
+  engine.Erase(value);
+}
+
+template <TreeEngine Engine>
+bool TreeAdapter<Engine>::Find(T value) {
+  return engine.Find(value);
+}
+
+template <TreeEngine Engine>
+size_t TreeAdapter<Engine>::FindBatch(std::span<const T> keys, std::span<uint8_t> results) {
+  return engine.FindBatch(keys, results);
+}
+
+template <TreeEngine Engine>
+void TreeAdapter<Engine>::GetVisualizationData(VisualizationData<T> &data) {
+  engine.GetVisualizationData(data);
+}
+
+template <TreeEngine Engine>
+const TraceRecorder* TreeAdapter<Engine>::GetTrace() const {
+  return engine.GetTrace();
+}
+
+template <TreeEngine Engine>
+TreeStats TreeAdapter<Engine>::GetStats() const {
+  return engine.GetStats();
+}
+
+#endif // TREEENGINE_IMPL
@@ -0,0 +1,124 @@
+#ifndef TREEENGINE_H
+#define TREEENGINE_H
+
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <span>
+#include <utility>
+#include "VisualizableTree.h"
+
+// Augmentation policies. Every node keeps a Data, recomputed by Update from
+// the node's keys and the Data of its children (nullptr for an empty slot)
+// whenever either changes. With NoAugment the calls compile away.
+struct NoAugment {
+  struct Data {};
+
+  static constexpr bool kEnabled = false;
+
+  template <typename T>
+  static void Update(Data &data, std::span<const T> keys, std::span<const Data* const> children);
+};
+
+// Number of keys in the subtree, the basis of order statistics.
+struct SubtreeSize {
+  struct Data {
+    size_t size = 0;
+  };
+
+  static constexpr bool kEnabled = true;
+
+  template <typename T>
+  static void Update(Data &data, std::span<const T> keys, std::span<const Data* const> children);
+};
+
+// What the GUI, the comparison and the benchmark need from an engine. The
+// engines implement it without virtual calls, so that code templated on the
+// engine inlines them.
+template <typename Engine>
+concept TreeEngine = requires(Engine &engine, const Engine &const_engine, typename Engine::KeyType key,
+                              VisualizationData<typename Engine::KeyType> &data) {
+  engine.Insert(key);
+  engine.Erase(key);
+  { engine.Find(key) } -> std::convertible_to<bool>;
+  { engine.FindBatch(std::span<const typename Engine::KeyType>(), std::span<uint8_t>()) } -> std::same_as<size_t>;
+  engine.GetVisualizationData(data);
+  { const_engine.GetStats() } -> std::same_as<TreeStats>;
+  { const_engine.GetTrace() } -> std::same_as<const TraceRecorder*>;
+  { const_engine.GetAugment() } -> std::same_as<typename Engine::AugmentData>;
+};
+
+// Batch operations mixed into every engine through CRTP; the loops call the
+// engine directly and inline its operations.
+template <typename Derived, typename T>
+class BatchOperations {
+ public:
+  template <typename Iterator>
+  void InsertAll(Iterator first, Iterator last);
+
+  template <typename Iterator>
+  void EraseAll(Iterator first, Iterator last);
+
+  // Number of the keys present in the tree.
+  template <typename Iterator>
+  size_t CountFound(Iterator first, Iterator last);
+
+  // Sets results[i] to whether keys[i] is in the tree and returns the number
+  // found. Engines that can interleave the lookups hide this one-by-one
+  // version with their own.
+  size_t FindBatch(std::span<const T> keys, std::span<uint8_t> results);
+
+ private:
+  Derived& Self();
+};
+
+enum class BatchStep {
+  kPending,
+  kFound,
+  kMissing
+};
+
+// Hints the cache to load address; nullptr is fine.
+void Prefetch(const void *address);
+
+// Lookups of many keys with their memory loads overlapped: a window of
+// lookups is advanced round-robin, one level each, and the node every lookup
+// goes to next is prefetched while the others take their turn. A lookup
+// starts at cursor start; step(cursor, key) moves it one level and returns
+// kFound, kMissing, or kPending with the address to prefetch.
+template <typename T, typename Cursor, typename Step>
+size_t InterleaveLookups(std::span<const T> keys, std::span<uint8_t> results, Cursor start, Step step);
+
+// Virtual interface over an engine, for the GUI.
+template <TreeEngine Engine>
+class TreeAdapter : public VisualizableTree<typename Engine::KeyType> {
+ public:
+  using T = typename Engine::KeyType;
+
+  Engine engine;
+
+  template <typename... Args>
+  explicit TreeAdapter(Args&&... args);
+
+  void Insert(T value) override;
+
+  void Erase(T value) override;
+
+  bool Find(T value) override;
+
+  size_t FindBatch(std::span<const T> keys, std::span<uint8_t> results) override;
+
+  void GetVisualizationData(VisualizationData<T> &data) override;
+
+  const TraceRecorder* GetTrace() const override;
+
+  TreeStats GetStats() const override;
+};
+
+// Engine with the default comparator and no augmentation that records a
+// trace, e.g. TracedEngine<AVLTree, int> for the GUI.
+template <template <typename, typename, typename, typename> class Engine, typename T,
+          typename Trace = TraceRecorder>
+using TracedEngine = Engine<T, std::less<T>, NoAugment, Trace>;
+
+#endif // TREEENGINE_H
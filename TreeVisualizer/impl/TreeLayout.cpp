@@ -0,0 +1,197 @@
+#ifndef TREELAYOUT_IMPL
+#define TREELAYOUT_IMPL
+
+#include "TreeLayout.h"
+#include <algorithm>
+#include <limits>
+
+inline int TreeShape::Size() const {
+  return int(child_begin.size()) - 1;
+}
+
+inline void TreeShape::Clear() {
+  child_begin.assign(1, 0);
+  children.clear();
+  widths.clear();
+  heights.clear();
+}
+
+inline void TreeShape::AddNode(double width, double height) {
+  child_begin.push_back(child_begin.back());
+  widths.push_back(width);
+  heights.push_back(height);
+}
+
+inline void TreeShape::AddChild(int child) {
+  children.push_back(child);
+  ++child_begin.back();
+}
+
+inline bool TreeLayout::IsLeaf(int v) const {
+  return v + 1 >= int(kid_begin_.size()) || kid_begin_[v] == kid_begin_[v + 1];
+}
+
+inline int TreeLayout::NextLeft(int v) const {
+  return IsLeaf(v) ? thread_[v] : kids_[kid_begin_[v]];
+}
+
+inline int TreeLayout::NextRight(int v) const {
+  return IsLeaf(v) ? thread_[v] : kids_[kid_begin_[v + 1] - 1];
+}
+
+inline double TreeLayout::Distance(int left, int right) const {
+  return (width_[left] + width_[right]) / 2 + sibling_gap;
+}
+
+inline void TreeLayout::MoveSubtree(int left, int right, double shift) {
+  double subtrees = number_[right] - number_[left];
+  change_[right] -= shift / subtrees;
+  shift_[right] += shift;
+  change_[left] += shift / subtrees;
+  prelim_[right] += shift;
+  mod_[right] += shift;
+}
+
+inline void TreeLayout::ExecuteShifts(int v) {
+  double shift = 0, change = 0;
+  for (int k = kid_begin_[v + 1] - 1; k >= kid_begin_[v]; k--) {
+    int w = kids_[k];
+    prelim_[w] += shift;
+    mod_[w] += shift;
+    change += change_[w];
+    shift += shift_[w] + change;
+  }
+}
+
+// Pushes the subtree of v right of its left siblings, walking the facing
+// contours of both; threads link the contours through shallower subtrees.
+inline int TreeLayout::Apportion(int v, int default_ancestor) {
+  if (number_[v] == 0) {
+    return default_ancestor;
+  }
+  int first = kid_begin_[parent_[v]];
+  int vir = v, vor = v, vil = kids_[first + number_[v] - 1], vol = kids_[first];
+  double sir = mod_[vir], sor = mod_[vor], sil = mod_[vil], sol = mod_[vol];
+  while (NextRight(vil) != -1 && NextLeft(vir) != -1) {
+    vil = NextRight(vil);
+    vir = NextLeft(vir);
+    vol = NextLeft(vol);
+    vor = NextRight(vor);
+    ancestor_[vor] = v;
+    double shift = (prelim_[vil] + sil) - (prelim_[vir] + sir) + Distance(vil, vir);
+    if (shift > 0) {
+      int left = parent_[ancestor_[vil]] == parent_[v] ? ancestor_[vil] : default_ancestor;
+      MoveSubtree(left, v, shift);
+      sir += shift;
+      sor += shift;
+    }
+    sil += mod_[vil];
+    sir += mod_[vir];
+    sol += mod_[vol];
+    sor += mod_[vor];
+  }
+  if (NextRight(vil) != -1 && NextRight(vor) == -1) {
+    thread_[vor] = NextRight(vil);
+    mod_[vor] += sil - sor;
+  }
+  if (NextLeft(vir) != -1 && NextLeft(vol) == -1) {
+    thread_[vol] = NextLeft(vir);
+    mod_[vol] += sir - sol;
+    default_ancestor = v;
+  }
+  return default_ancestor;
+}
+
+inline void TreeLayout::Compute(const TreeShape &shape) {
+  int n = shape.Size();
+  x.assign(n, 0);
+  y.assign(n, 0);
+  width = height = 0;
+  if (n == 0) {
+    return;
+  }
+  // A node with at least one child gets a leaf in place of each empty slot.
+  int m = n;
+  kids_.clear();
+  kid_begin_.resize(n + 1);
+  for (int v = 0; v < n; v++) {
+    kid_begin_[v] = kids_.size();
+    int begin = shape.child_begin[v], end = shape.child_begin[v + 1];
+    if (std::any_of(shape.children.begin() + begin, shape.children.begin() + end,
+                    [](int child) { return child != -1; })) {
+      for (int k = begin; k < end; k++) {
+        kids_.push_back(shape.children[k] != -1 ? shape.children[k] : m++);
+      }
+    }
+  }
+  kid_begin_[n] = kids_.size();
+  width_.resize(m);
+  std::copy(shape.widths.begin(), shape.widths.end(), width_.begin());
+  std::fill(width_.begin() + n, width_.end(), empty_slot_width);
+  parent_.assign(m, -1);
+  number_.assign(m, 0);
+  thread_.assign(m, -1);
+  ancestor_.resize(m);
+  for (int v = 0; v < m; v++) {
+    ancestor_[v] = v;
+  }
+  prelim_.assign(m, 0);
+  mod_.assign(m, 0);
+  shift_.assign(m, 0);
+  change_.assign(m, 0);
+  midpoint_.assign(m, 0);
+  for (int v = 0; v < n; v++) {
+    for (int k = kid_begin_[v]; k < kid_begin_[v + 1]; k++) {
+      parent_[kids_[k]] = v;
+      number_[kids_[k]] = k - kid_begin_[v];
+    }
+  }
+
+  // First walk, children before parents. The subtrees of all children of v
+  // are complete, so v places them next to each other and centers over them.
+  for (int v = n - 1; v >= 0; v--) {
+    if (IsLeaf(v)) {
+      continue;
+    }
+    int default_ancestor = kids_[kid_begin_[v]];
+    for (int k = kid_begin_[v]; k < kid_begin_[v + 1]; k++) {
+      int w = kids_[k];
+      if (k > kid_begin_[v]) {
+        int left = kids_[k - 1];
+        prelim_[w] = prelim_[left] + Distance(left, w);
+        if (!IsLeaf(w)) {
+          mod_[w] = prelim_[w] - midpoint_[w];
+        }
+      } else {
+        prelim_[w] = midpoint_[w];
+      }
+      default_ancestor = Apportion(w, default_ancestor);
+    }
+    ExecuteShifts(v);
+    midpoint_[v] = (prelim_[kids_[kid_begin_[v]]] + prelim_[kids_[kid_begin_[v + 1] - 1]]) / 2;
+  }
+  prelim_[0] = midpoint_[0];
+
+  // Second walk, parents before children: the position of a node is its
+  // preliminary one plus the modifiers of all its ancestors.
+  offset_.assign(m, 0);
+  double min_x = std::numeric_limits<double>::max();
+  for (int v = 0; v < n; v++) {
+    x[v] = prelim_[v] + offset_[v] - width_[v] / 2;
+    min_x = std::min(min_x, x[v]);
+    for (int k = kid_begin_[v]; k < kid_begin_[v + 1]; k++) {
+      int w = kids_[k];
+      offset_[w] = offset_[v] + mod_[v];
+      if (w < n) {
+        y[w] = y[v] + shape.heights[v] + level_gap;
+      }
+    }
+  }
+  for (int v = 0; v < n; v++) {
+    x[v] -= min_x;
+    width = std::max(width, x[v] + shape.widths[v]);
+    height = std::max(height, y[v] + shape.heights[v]);
+  }
+}
+
+#endif // TREELAYOUT_IMPL
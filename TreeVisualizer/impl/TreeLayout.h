@@ -0,0 +1,62 @@
+#ifndef TREELAYOUT_H
+#define TREELAYOUT_H
+
+#include <vector>
+
+// Compact shape of a tree to lay out. Every node comes after its parent
+// (BFS order works) and node 0 is the root. The children of node v are
+// children[child_begin[v]] .. children[child_begin[v + 1] - 1], where -1 marks
+// an empty slot, e.g. the missing child of a binary node.
+struct TreeShape {
+  std::vector<int> child_begin = {0};
+  std::vector<int> children;
+  std::vector<double> widths, heights;
+
+  int Size() const;
+
+  // Empties the shape, keeping the capacity of the arrays.
+  void Clear();
+
+  // Appends a node; its children are then added with AddChild.
+  void AddNode(double width, double height);
+
+  void AddChild(int child);
+};
+
+// Tidy drawing of a tree with nodes of varying width in O(n): Walker's
+// algorithm with the linear-time improvements of Buchheim, Juenger and
+// Leipert. Works for binary trees and B-Trees alike and uses no recursion.
+class TreeLayout {
+ public:
+  double level_gap = 30, sibling_gap = 50;
+  // Width reserved for an empty child slot next to a non-empty one.
+  double empty_slot_width = 0;
+
+  // Left and top edges of the nodes; the drawing starts at (0, 0).
+  std::vector<double> x, y;
+  double width = 0, height = 0;
+
+  void Compute(const TreeShape &shape);
+
+ private:
+  // Per-node state of the algorithm, kept between calls. Nodes past the end
+  // of the shape are the empty slots, laid out as leaves.
+  std::vector<int> kid_begin_, kids_, parent_, number_, thread_, ancestor_;
+  std::vector<double> width_, prelim_, mod_, shift_, change_, midpoint_, offset_;
+
+  bool IsLeaf(int v) const;
+
+  int NextLeft(int v) const;
+
+  int NextRight(int v) const;
+
+  double Distance(int left, int right) const;
+
+  int Apportion(int v, int default_ancestor);
+
+  void MoveSubtree(int left, int right, double shift);
+
+  void ExecuteShifts(int v);
+};
+
+#endif // TREELAYOUT_H
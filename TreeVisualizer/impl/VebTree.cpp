@@ -0,0 +1,358 @@
+#ifndef VEBTREE_IMPL
+#define VEBTREE_IMPL
+
+#include "VebTree.h"
+#include <bit>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include <algorithm>
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+VebTree<T, Compare, Augment, Trace>::~VebTree() {
+  std::vector<Node*> stack;
+  if (root_ != nullptr) {
+    stack.push_back(root_);
+  }
+  while (!stack.empty()) {
+    Node *node = stack.back();
+    stack.pop_back();
+    stack.insert(stack.end(), node->children.begin(), node->children.end());
+    delete node;
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+VebTree<T, Compare, Augment, Trace>::Bits VebTree<T, Compare, Augment, Trace>::ToBits(T key) {
+  if constexpr (std::is_signed_v<T>) {
+    return Bits(key) ^ Bits(Bits(1) << (kBits - 1));
+  } else {
+    return key;
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+T VebTree<T, Compare, Augment, Trace>::FromBits(Bits bits) {
+  if constexpr (std::is_signed_v<T>) {
+    return T(Bits(bits ^ Bits(Bits(1) << (kBits - 1))));
+  } else {
+    return bits;
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+int VebTree<T, Compare, Augment, Trace>::Shift(int level) {
+  return (kLevels - 1 - level) * kChunk;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+int VebTree<T, Compare, Augment, Trace>::Chunk(Bits bits, int level) {
+  return int(bits >> Shift(level)) & 63;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+VebTree<T, Compare, Augment, Trace>::Bits VebTree<T, Compare, Augment, Trace>::Prefix(Bits bits, int level) {
+  int low = Shift(level) + kChunk;
+  return low >= kBits ? 0 : Bits(bits >> low << low);
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+int VebTree<T, Compare, Augment, Trace>::Rank(uint64_t bits, int index) {
+  return std::popcount(bits & ((uint64_t(1) << index) - 1));
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+VebTree<T, Compare, Augment, Trace>::Bits VebTree<T, Compare, Augment, Trace>::Extreme(const Node *node, int level,
+                                                                                      Bits prefix, bool largest) {
+  for (;; level++) {
+    int index = largest ? 63 - std::countl_zero(node->bits) : std::countr_zero(node->bits);
+    prefix |= Bits(Bits(index) << Shift(level));
+    if (level == kLevels - 1) {
+      return prefix;
+    }
+    node = largest ? node->children.back() : node->children.front();
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void VebTree<T, Compare, Augment, Trace>::UpdateAugment(Node *node, int level, Bits key) {
+  if constexpr (Augment::kEnabled) {
+    leaf_keys_.clear();
+    child_augments_.clear();
+    if (level == kLevels - 1) {
+      for (uint64_t rest = node->bits; rest != 0; rest &= rest - 1) {
+        leaf_keys_.push_back(FromBits(Prefix(key, level) | Bits(std::countr_zero(rest))));
+      }
+    } else {
+      for (const Node *child : node->children) {
+        child_augments_.push_back(&child->augment);
+      }
+    }
+    Augment::template Update<T>(node->augment, leaf_keys_, child_augments_);
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void VebTree<T, Compare, Augment, Trace>::Insert(T value) {
+  trace_.Record(TraceEvent::kInsert, nullptr);
+  Bits key = ToBits(value);
+  if (root_ == nullptr) {
+    root_ = new Node();
+  }
+  path_.clear();
+  Node *node = root_;
+  for (int level = 0;; level++) {
+    trace_.Record(TraceEvent::kVisit, node);
+    if constexpr (Augment::kEnabled) {
+      path_.push_back(node);
+    }
+    int index = Chunk(key, level);
+    uint64_t bit = uint64_t(1) << index;
+    if (level == kLevels - 1) {
+      if (node->bits & bit) {
+        path_.clear();
+        return;
+      }
+      node->bits |= bit;
+      break;
+    }
+    if (!(node->bits & bit)) {
+      node->children.insert(node->children.begin() + Rank(node->bits, index), new Node());
+      node->bits |= bit;
+    }
+    node = node->children[Rank(node->bits, index)];
+  }
+  for (int level = int(path_.size()) - 1; level >= 0; level--) {
+    UpdateAugment(path_[level], level, key);
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void VebTree<T, Compare, Augment, Trace>::Erase(T value) {
+  trace_.Record(TraceEvent::kErase, nullptr);
+  Bits key = ToBits(value);
+  Node *nodes[kLevels];
+  Node *node = root_;
+  for (int level = 0; level < kLevels; level++) {
+    if (node == nullptr) {
+      return;
+    }
+    trace_.Record(TraceEvent::kVisit, node);
+    nodes[level] = node;
+    int index = Chunk(key, level);
+    if (!(node->bits >> index & 1)) {
+      return;
+    }
+    if (level < kLevels - 1) {
+      node = node->children[Rank(node->bits, index)];
+    }
+  }
+  // Clear the bit of the key, and of every node that it leaves empty.
+  for (int level = kLevels - 1; level >= 0; level--) {
+    node = nodes[level];
+    int index = Chunk(key, level);
+    if (level < kLevels - 1) {
+      node->children.erase(node->children.begin() + Rank(node->bits, index));
+    }
+    node->bits &= ~(uint64_t(1) << index);
+    if (node->bits != 0) {
+      for (; level >= 0; level--) {
+        UpdateAugment(nodes[level], level, key);
+      }
+      return;
+    }
+    if (node == selected_) {
+      selected_ = nullptr;
+    }
+    delete node;
+  }
+  root_ = nullptr;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+bool VebTree<T, Compare, Augment, Trace>::Find(T value) {
+  trace_.Record(TraceEvent::kFind, nullptr);
+  Bits key = ToBits(value);
+  Node *node = root_;
+  for (int level = 0; node != nullptr; level++) {
+    trace_.Record(TraceEvent::kVisit, node);
+    int index = Chunk(key, level);
+    if (!(node->bits >> index & 1)) {
+      break;
+    }
+    if (level == kLevels - 1) {
+      selected_ = node;
+      selected_key_ = value;
+      return true;
+    }
+    node = node->children[Rank(node->bits, index)];
+  }
+  selected_ = nullptr;
+  return false;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+size_t VebTree<T, Compare, Augment, Trace>::FindBatch(std::span<const T> keys, std::span<uint8_t> results) {
+  if constexpr (Trace::kEnabled) {
+    // One by one, so that the events of every lookup stay together.
+    return BatchOperations<VebTree, T>::FindBatch(keys, results);
+  } else {
+    // A level takes two steps: the node's bits, then the slot of the child
+    // in its separately allocated array.
+    struct Cursor {
+      const Node *node;
+      Node *const *slot;
+      int level;
+    };
+    return InterleaveLookups(keys, results, Cursor{root_, nullptr, 0}, [](Cursor &cursor, const T &value) {
+      using Step = std::pair<BatchStep, const void*>;
+      if (cursor.slot != nullptr) {
+        cursor = {*cursor.slot, nullptr, cursor.level + 1};
+        return Step(BatchStep::kPending, cursor.node);
+      }
+      if (cursor.node == nullptr) {
+        return Step(BatchStep::kMissing, nullptr);
+      }
+      int index = Chunk(ToBits(value), cursor.level);
+      if (!(cursor.node->bits >> index & 1)) {
+        return Step(BatchStep::kMissing, nullptr);
+      }
+      if (cursor.level == kLevels - 1) {
+        return Step(BatchStep::kFound, nullptr);
+      }
+      cursor.slot = cursor.node->children.data() + Rank(cursor.node->bits, index);
+      return Step(BatchStep::kPending, cursor.slot);
+    });
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+std::optional<T> VebTree<T, Compare, Augment, Trace>::Neighbor(T value, bool next) const {
+  if (root_ == nullptr) {
+    return std::nullopt;
+  }
+  // Go down the path of the key as far as it exists, then back up to the
+  // first level with an occupied index past the path's; the answer is the
+  // nearest key under that index.
+  Bits key = ToBits(value);
+  const Node *nodes[kLevels];
+  int depth = 0;
+  for (const Node *node = root_;; depth++) {
+    nodes[depth] = node;
+    int index = Chunk(key, depth);
+    if (depth == kLevels - 1 || !(node->bits >> index & 1)) {
+      break;
+    }
+    node = node->children[Rank(node->bits, index)];
+  }
+  for (int level = depth; level >= 0; level--) {
+    uint64_t bits = nodes[level]->bits;
+    int index = Chunk(key, level);
+    uint64_t past = next ? (index == 63 ? 0 : bits & ~uint64_t(0) << (index + 1))
+                         : bits & ((uint64_t(1) << index) - 1);
+    if (past == 0) {
+      continue;
+    }
+    int chosen = next ? std::countr_zero(past) : 63 - std::countl_zero(past);
+    Bits prefix = Prefix(key, level) | Bits(Bits(chosen) << Shift(level));
+    if (level == kLevels - 1) {
+      return FromBits(prefix);
+    }
+    return FromBits(Extreme(nodes[level]->children[Rank(bits, chosen)], level + 1, prefix, !next));
+  }
+  return std::nullopt;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+std::optional<T> VebTree<T, Compare, Augment, Trace>::Successor(T key) const {
+  return Neighbor(key, true);
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+std::optional<T> VebTree<T, Compare, Augment, Trace>::Predecessor(T key) const {
+  return Neighbor(key, false);
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+void VebTree<T, Compare, Augment, Trace>::GetVisualizationData(VisualizationData<T> &data) {
+  data.Clear();
+  // Preorder with an explicit stack: node, its level and key prefix, index of
+  // its parent, child slot.
+  std::vector<std::tuple<Node*, int, Bits, int, int>> stack;
+  if (root_ != nullptr) {
+    stack.emplace_back(root_, 0, 0, -1, 0);
+  }
+  while (!stack.empty()) {
+    auto [node, level, prefix, parent, slot] = stack.back();
+    stack.pop_back();
+    bool leaf = level == kLevels - 1;
+    int count = std::popcount(node->bits);
+    int index = data.AddNode(reinterpret_cast<uintptr_t>(node), leaf ? 0 : count);
+    int rank = 0;
+    for (uint64_t rest = node->bits; rest != 0; rest &= rest - 1, rank++) {
+      Bits start = prefix | Bits(Bits(std::countr_zero(rest)) << Shift(level));
+      if (leaf) {
+        T key = FromBits(start);
+        data.AddKey(key, VisualizationData<T>::kPlain, node == selected_ && key == selected_key_);
+      } else {
+        data.AddKey(FromBits(start), VisualizationData<T>::kBlack, false, false);
+      }
+    }
+    if (parent != -1) {
+      data.SetChild(parent, slot, index);
+    }
+    if (!leaf) {
+      rank = count;
+      for (uint64_t rest = node->bits; rest != 0; rest &= ~(uint64_t(1) << (63 - std::countl_zero(rest)))) {
+        Bits start = prefix | Bits(Bits(63 - std::countl_zero(rest)) << Shift(level));
+        --rank;
+        stack.emplace_back(node->children[rank], level + 1, start, index, rank);
+      }
+    }
+  }
+  selected_ = nullptr;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+const TraceRecorder* VebTree<T, Compare, Augment, Trace>::GetTrace() const {
+  if constexpr (std::is_same_v<Trace, TraceRecorder>) {
+    return &trace_;
+  } else {
+    return nullptr;
+  }
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+const Trace& VebTree<T, Compare, Augment, Trace>::GetTracePolicy() const {
+  return trace_;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+TreeStats VebTree<T, Compare, Augment, Trace>::GetStats() const {
+  TreeStats stats;
+  std::vector<std::pair<Node*, int>> stack;
+  if (root_ != nullptr) {
+    stack.emplace_back(root_, 1);
+  }
+  while (!stack.empty()) {
+    auto [node, depth] = stack.back();
+    stack.pop_back();
+    stats.nodes++;
+    stats.bytes += sizeof(Node) + node->children.capacity() * sizeof(Node*);
+    stats.height = std::max(stats.height, depth);
+    if (depth == kLevels) {
+      stats.keys += std::popcount(node->bits);
+    }
+    for (Node *child : node->children) {
+      stack.emplace_back(child, depth + 1);
+    }
+  }
+  return stats;
+}
+
+template <typename T, typename Compare, typename Augment, typename Trace>
+VebTree<T, Compare, Augment, Trace>::AugmentData VebTree<T, Compare, Augment, Trace>::GetAugment() const {
+  return root_ != nullptr ? root_->augment : AugmentData();
+}
+
+#endif // VEBTREE_IMPL
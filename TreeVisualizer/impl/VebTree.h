@@ -0,0 +1,106 @@
+#ifndef VEBTREE_H
+#define VEBTREE_H
+
+#include <optional>
+#include <type_traits>
+#include <vector>
+#include "TreeEngine.h"
+
+// Integer set in the manner of a van Emde Boas tree: a trie over the key
+// bits, 6 bits per level, whose nodes are 64-bit words with a bit per
+// occupied child (per key on the last level). A 32-bit key takes 6 levels,
+// so membership, successor and predecessor cost a few word operations
+// however many keys there are. Only the occupied children are stored, in a
+// packed array indexed by the rank of their bit.
+//
+// Keys are ordered as integers, so Compare must be std::less<T>.
+// Augment: see TreeEngine.h; Trace: see OperationTrace.h.
+template <typename T, typename Compare = std::less<T>, typename Augment = NoAugment, typename Trace = NoTrace>
+class VebTree : public BatchOperations<VebTree<T, Compare, Augment, Trace>, T> {
+  static_assert(std::is_integral_v<T>, "VebTree keys are integers");
+  static_assert(std::is_same_v<Compare, std::less<T>>, "VebTree keys are in numeric order");
+
+ public:
+  using KeyType = T;
+  using AugmentData = typename Augment::Data;
+
+  VebTree() = default;
+
+  VebTree(const VebTree&) = delete;
+  VebTree& operator=(const VebTree&) = delete;
+
+  ~VebTree();
+
+  void Insert(T value);
+
+  void Erase(T value);
+
+  bool Find(T value);
+
+  // Interleaves the lookups unless the engine records a trace.
+  size_t FindBatch(std::span<const T> keys, std::span<uint8_t> results);
+
+  // Smallest key greater than key.
+  std::optional<T> Successor(T key) const;
+
+  // Largest key less than key.
+  std::optional<T> Predecessor(T key) const;
+
+  // Internal nodes are drawn with the smallest key of every child's range,
+  // in black; the last level with its keys.
+  void GetVisualizationData(VisualizationData<T> &data);
+
+  const TraceRecorder* GetTrace() const;
+
+  const Trace& GetTracePolicy() const;
+
+  TreeStats GetStats() const;
+
+  // Augment data of the whole tree.
+  AugmentData GetAugment() const;
+
+ private:
+  using Bits = std::make_unsigned_t<T>;
+
+  static constexpr int kBits = sizeof(T) * 8, kChunk = 6, kLevels = (kBits + kChunk - 1) / kChunk;
+
+  struct Node {
+    uint64_t bits = 0;
+    std::vector<Node*> children;
+    [[no_unique_address]] AugmentData augment;
+  };
+
+  Node *root_ = nullptr, *selected_ = nullptr;
+  T selected_key_ = T();
+  [[no_unique_address]] Trace trace_;
+  // Nodes on the path of an insert, root first, and scratch for Augment.
+  std::vector<Node*> path_;
+  std::vector<T> leaf_keys_;
+  std::vector<const AugmentData*> child_augments_;
+
+  // Order-preserving map to unsigned, and back.
+  static Bits ToBits(T key);
+  static T FromBits(Bits bits);
+
+  static int Shift(int level);
+
+  static int Chunk(Bits bits, int level);
+
+  // The bits of key above the chunk of level.
+  static Bits Prefix(Bits bits, int level);
+
+  // Position in children of the child with the given index.
+  static int Rank(uint64_t bits, int index);
+
+  // Smallest or largest key under node, whose bits above its level are
+  // those of prefix.
+  static Bits Extreme(const Node *node, int level, Bits prefix, bool largest);
+
+  // Common part of Successor and Predecessor.
+  std::optional<T> Neighbor(T key, bool next) const;
+
+  // Keys of node, which is on the path of key.
+  void UpdateAugment(Node *node, int level, Bits key);
+};
+
+#endif // VEBTREE_H
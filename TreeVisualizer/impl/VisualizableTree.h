@@ -0,0 +1,113 @@
+#ifndef VISUALIZABLETREE_H
+#define VISUALIZABLETREE_H
+
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "OperationTrace.h"
+
+// Snapshot of a tree for drawing, as flat arrays that keep their capacity
+// between snapshots. Nodes are numbered so that parents come before their
+// children, node 0 being the root. Keys are stored as they are; labels are
+// only formatted when drawn.
+template <typename T>
+struct VisualizationData {
+  enum ColorClass : uint8_t {
+    kPlain,
+    kRed,
+    kBlack
+  };
+
+  // Per node: stable identity across snapshots, and the ranges of its
+  // children and keys, child_begin[v] .. child_begin[v + 1] - 1 and
+  // key_begin[v] .. key_begin[v + 1] - 1.
+  std::vector<uint64_t> ids;
+  std::vector<int> child_begin = {0}, key_begin = {0};
+  // Child node indices, -1 for an empty slot.
+  std::vector<int> children;
+  // Per key. A key that is not a member only labels where the range of a
+  // child starts, as in the inner nodes of VebTree and ArtTree.
+  std::vector<T> keys;
+  std::vector<ColorClass> colors;
+  std::vector<uint8_t> selected, members;
+
+  int Size() const {
+    return ids.size();
+  }
+
+  void Clear() {
+    ids.clear();
+    child_begin.assign(1, 0);
+    key_begin.assign(1, 0);
+    children.clear();
+    keys.clear();
+    colors.clear();
+    selected.clear();
+    members.clear();
+  }
+
+  // Appends a node with child_count empty child slots and returns its index.
+  // Its keys are the ones added by AddKey until the next node.
+  int AddNode(uint64_t id, int child_count) {
+    ids.push_back(id);
+    child_begin.push_back(child_begin.back() + child_count);
+    children.resize(children.size() + child_count, -1);
+    key_begin.push_back(key_begin.back());
+    return ids.size() - 1;
+  }
+
+  void AddKey(const T &key, ColorClass color, bool is_selected, bool is_member = true) {
+    keys.push_back(key);
+    colors.push_back(color);
+    selected.push_back(is_selected);
+    members.push_back(is_member);
+    ++key_begin.back();
+  }
+
+  // The keys of the tree, without the range labels.
+  std::vector<T> MemberKeys() const {
+    std::vector<T> result;
+    for (size_t k = 0; k < keys.size(); k++) {
+      if (members[k]) {
+        result.push_back(keys[k]);
+      }
+    }
+    return result;
+  }
+
+  void SetChild(int node, int slot, int child) {
+    children[child_begin[node] + slot] = child;
+  }
+};
+
+// Size of a tree. Memory counts the nodes and their arrays, not the
+// allocator overhead.
+struct TreeStats {
+  size_t keys = 0, nodes = 0, bytes = 0;
+  int height = 0;
+};
+
+// Virtual interface to a tree for the GUI. The engines themselves are not
+// virtual; TreeAdapter in TreeEngine.h implements this over any of them.
+template <typename T>
+struct VisualizableTree {
+  virtual void Insert(T value) = 0;
+  virtual void Erase(T value) = 0;
+  virtual bool Find(T value) = 0;
+
+  // Looks up all keys, see BatchOperations::FindBatch.
+  virtual size_t FindBatch(std::span<const T> keys, std::span<uint8_t> results) = 0;
+
+  // Replaces the contents of data with a snapshot of the tree.
+  virtual void GetVisualizationData(VisualizationData<T> &data) = 0;
+
+  // Trace of the recent operations, or nullptr if the tree does not record one.
+  virtual const TraceRecorder* GetTrace() const = 0;
+
+  // Walks the whole tree.
+  virtual TreeStats GetStats() const = 0;
+
+  virtual ~VisualizableTree() = default;
+};
+
+#endif // VISUALIZABLETREE_H
@@ -3,151 +3,506 @@
 
 #include <QGraphicsScene>
 #include <QGraphicsView>
-#include <QGraphicsRectItem>
+#include <QGraphicsItem>
 #include <QFontMetrics>
+#include <QStaticText>
+#include <QTransform>
 #include <QApplication>
 #include <QColor>
 #include <QWidget>
 #include <QPen>
+#include <QLineF>
+#include <algorithm>
+#include <limits>
+#include <cstdlib>
 #include <vector>
-#include <string>
 #include <tuple>
 #include <utility>
 #include <iostream>
 
 #include "Visualization.h"
 
-static void Visualize(VisualizableTree<int> *tree, QWidget *widget,
-    QGraphicsScene *scene, VisualizationData *data) {
-  scene->clear();
-  constexpr qreal kHeightMargin = 30, kPadding = 10, kWidthMargin = 50;
-  constexpr qreal kOneChildHack = kWidthMargin;
-  auto GetWidth = [&](VisualizationData *data) -> qreal {
-    qreal width = 0;
-    for (auto [item, text_item] : data->items) {
-      if (item != nullptr) {
-        width += item->rect().width();
+constexpr qreal kHeightMargin = 30, kPadding = 10, kWidthMargin = 50;
+// Default document margin of a QGraphicsTextItem, kept for the same look.
+constexpr qreal kTextMargin = 4;
+// Labels and clicks need the keys to be at least this tall on screen.
+constexpr qreal kMinLabelPixels = 6;
+// Outline of the nodes on the traced path.
+const QColor kPathColor("#FFA500");
+
+inline LabelCache::LabelCache(const QFont &font) : font_(font), metrics_(font) {
+  digit_width_ = metrics_.horizontalAdvance(QChar('0'));
+  for (char digit = '1'; digit <= '9'; digit++) {
+    if (metrics_.horizontalAdvance(QChar(digit)) != digit_width_) {
+      digit_width_ = -1;
+    }
+  }
+  minus_width_ = metrics_.horizontalAdvance(QChar('-'));
+}
+
+inline const QFont& LabelCache::Font() const {
+  return font_;
+}
+
+inline qreal LabelCache::Height() const {
+  return metrics_.height();
+}
+
+inline qreal LabelCache::Width(int key) {
+  if (digit_width_ >= 0) {
+    int digits = 1;
+    for (int64_t rest = std::abs(int64_t(key)); rest >= 10; rest /= 10) {
+      digits++;
+    }
+    return digits * digit_width_ + (key < 0) * minus_width_;
+  }
+  auto iter = widths_.find(key);
+  if (iter == widths_.end()) {
+    if (widths_.size() >= kMaxEntries) {
+      widths_.clear();
+    }
+    iter = widths_.emplace(key, metrics_.horizontalAdvance(QString::number(key))).first;
+  }
+  return iter->second;
+}
+
+inline const QStaticText& LabelCache::Text(int key) {
+  auto iter = texts_.find(key);
+  if (iter == texts_.end()) {
+    if (texts_.size() >= kMaxEntries) {
+      texts_.clear();
+    }
+    QStaticText text(QString::number(key));
+    text.setPerformanceHint(QStaticText::AggressiveCaching);
+    text.prepare(QTransform(), font_);
+    iter = texts_.emplace(key, std::move(text)).first;
+  }
+  return iter->second;
+}
+
+inline TreeItem::TreeItem() : label_cache(QApplication::font()) {
+  setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
+}
+
+inline QRectF TreeItem::boundingRect() const {
+  return rect_;
+}
+
+inline void TreeItem::Rebuild(QRectF rect, bool clickable) {
+  prepareGeometryChange();
+  rect_ = rect;
+  grid_.Clear();
+  if (clickable) {
+    for (const QRectF &key_rect : key_rects) {
+      grid_.Add({key_rect.left(), key_rect.top(), key_rect.right(), key_rect.bottom()});
+    }
+  }
+  grid_.Build();
+  update();
+}
+
+inline void TreeItem::mousePressEvent(QGraphicsSceneMouseEvent *event) {
+  int key = grid_.Find(event->pos().x(), event->pos().y());
+  if (event->button() != Qt::LeftButton || key == -1 || !members[key] ||
+      key_rects[key].height() * last_lod_ < kMinLabelPixels) {
+    // Let the view start a hand drag instead.
+    event->ignore();
+    return;
+  }
+  if (on_clicked) {
+    on_clicked(keys[key]);
+  }
+}
+
+inline void TreeItem::DrawSummary(QPainter *painter, int node, qreal lod) {
+  const QRectF &rect = bounds[node];
+  painter->setPen(QPen(QColor("#9A9A9C")));
+  painter->setBrush(QColor("#E4E4E6"));
+  painter->drawRect(rect);
+  // Text is drawn in device pixels so that it stays readable when zoomed out.
+  QRectF box(0, 0, rect.width() * lod, rect.height() * lod);
+  QFontMetricsF metrics(painter->font());
+  QString full = QString("%1 keys\n[%2, %3]").arg(counts[node]).arg(min_keys[node]).arg(max_keys[node]);
+  QRectF full_rect = metrics.boundingRect(box, Qt::AlignCenter, full);
+  QString text;
+  if (full_rect.width() <= box.width() && full_rect.height() <= box.height()) {
+    text = full;
+  } else if (metrics.horizontalAdvance(QString::number(counts[node])) <= box.width() &&
+             metrics.height() <= box.height()) {
+    text = QString::number(counts[node]);
+  } else {
+    return;
+  }
+  painter->save();
+  painter->translate(rect.topLeft());
+  painter->scale(1 / lod, 1 / lod);
+  painter->setPen(QPen(Qt::black));
+  painter->drawText(box, Qt::AlignCenter, text);
+  painter->restore();
+}
+
+inline void TreeItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option,
+                            QWidget *widget) {
+  if (bounds.empty()) {
+    return;
+  }
+  qreal lod = QStyleOptionGraphicsItem::levelOfDetailFromTransform(painter->worldTransform());
+  last_lod_ = lod;
+  const QRectF &exposed = option->exposedRect;
+  visible_keys_.clear();
+  visible_edges_.clear();
+  summaries_.clear();
+  stack_.assign(1, 0);
+  while (!stack_.empty()) {
+    int v = stack_.back();
+    stack_.pop_back();
+    if (!bounds[v].intersects(exposed)) {
+      continue;
+    }
+    if (counts[v] > 1 && std::max(bounds[v].width(), bounds[v].height()) * lod < summary_pixels) {
+      summaries_.push_back(v);
+      continue;
+    }
+    for (int k = key_begin[v]; k < key_begin[v + 1]; k++) {
+      if (key_rects[k].intersects(exposed)) {
+        visible_keys_.push_back(k);
       }
     }
-    return width;
-  };
-  auto MakeItem = [&](int& x, int& y, VisualizationData *cur, int index) {
-    std::string value = cur->keys[index];
-    auto [back_color, fore_color] = cur->colors[index];
-    QFontMetrics fm(QApplication::font());
-    QRectF textRect = fm.boundingRect(QString::fromStdString(value));
-    textRect.setX(x), textRect.setY(y);
-    cur->items.push_back(std::make_pair(new NodeItem(), new QGraphicsTextItem()));
-    cur->items.back().first->setBrush(back_color);
-    cur->items.back().second->setPlainText(QString::fromStdString(value));
-    cur->items.back().second->setX(x + kPadding);
-    cur->items.back().second->setY(y + kPadding);
-    cur->items.back().second->setDefaultTextColor(fore_color);
-    textRect.setWidth(cur->items.back().second->boundingRect().width() + 2 * kPadding);
-    textRect.setHeight(cur->items.back().second->boundingRect().height() + 2 * kPadding);
-    cur->items.back().first->setRect(textRect);
-    cur->items.back().first->value = std::stoi(value);
-    cur->items.back().first->ds = tree;
-    cur->items.back().first->widget = widget;
-    cur->items.back().first->scene = scene;
-    widget->connect(cur->items.back().first, &NodeItem::clicked, [](NodeItem *item) {
-      item->ds->Erase(item->value);
-      Visualize(item->ds, item->widget, item->scene, item->ds->GetVisualizationData());
-    });
-    x += textRect.width();
-  };
-  auto PreinitItems = [&](auto&& self, VisualizationData *cur) -> void {
-    if (cur == nullptr) {
-      return;
-    }
-    int x = 0, y = 0;
-    for (int i = 0; i < int(cur->keys.size()); i++) {
-      MakeItem(x, y, cur, i);
-    }
-    bool left_hack = false, right_hack = false;
-    if (cur->children.size() == 2) {
-      if (cur->children[0] != nullptr && cur->children[1] == nullptr) {
-        left_hack = true; 
+    for (int k = child_begin[v]; k < child_begin[v + 1]; k++) {
+      if (int child = children[k]; child != -1) {
+        visible_edges_.push_back(edges[child]);
+        stack_.push_back(child);
       }
-      if (cur->children[0] == nullptr && cur->children[1] != nullptr) {
-        right_hack = true;
+    }
+  }
+  painter->setPen(QPen(Qt::black));
+  painter->drawLines(visible_edges_.data(), visible_edges_.size());
+  // One batch of rects per color.
+  for (int color = 0; color < int(palette.size()); color++) {
+    batch_.clear();
+    for (int k : visible_keys_) {
+      if (key_colors[k] == color) {
+        batch_.push_back(key_rects[k]);
       }
     }
-    qreal children_width = 0;
-    for (auto child : cur->children) {
-      self(self, child);
-      if (child != nullptr) {
-        children_width += child->total_width + kWidthMargin;
+    painter->setBrush(palette[color].first);
+    painter->drawRects(batch_.data(), batch_.size());
+  }
+  if (!key_rects.empty() && key_rects[0].height() * lod >= kMinLabelPixels) {
+    painter->setFont(label_cache.Font());
+    int pen_color = -1;
+    for (int k : visible_keys_) {
+      if (key_colors[k] != pen_color) {
+        pen_color = key_colors[k];
+        painter->setPen(palette[pen_color].second);
       }
+      const QStaticText &text = label_cache.Text(keys[k]);
+      QPointF center = key_rects[k].center();
+      painter->drawStaticText(QPointF(center.x() - text.size().width() / 2,
+                                      center.y() - text.size().height() / 2), text);
     }
-    if (children_width > 0) {
-      children_width -= kWidthMargin;
+  }
+  if (!path.empty()) {
+    painter->setPen(QPen(kPathColor, 3));
+    painter->setBrush(Qt::NoBrush);
+    for (int v : path) {
+      painter->drawRect(QRectF(key_rects[key_begin[v]].topLeft(), key_rects[key_begin[v + 1] - 1].bottomRight()));
     }
-    cur->total_width = std::max(GetWidth(cur), children_width);
-    if (left_hack || right_hack) {
-      cur->total_width += kOneChildHack; 
+    for (int v : path_edges) {
+      painter->drawLine(edges[v]);
     }
+  }
+  for (int v : summaries_) {
+    DrawSummary(painter, v, lod);
+  }
+}
+
+// Palette of TreeItem: the color classes of VisualizationData, then the
+// color of the selected key.
+constexpr int kSelectedColor = 3;
+
+// Interval of the animation timer, and of the precomputed frames.
+constexpr int kFrameInterval = 16;
+
+inline SceneUpdater::SceneUpdater(VisualizableTree<int> *tree, QGraphicsView *view,
+                                  VisualizationData<int> *snapshot)
+    : tree_(tree), view_(view), snapshot_(snapshot), item_(new TreeItem()), timer_(new QTimer(this)) {
+  layout_.level_gap = kHeightMargin;
+  layout_.sibling_gap = kWidthMargin;
+  item_->palette = {
+    {QColor("#CDCDCE"), QColor(Qt::black)},
+    {QColor(Qt::red), QColor(Qt::white)},
+    {QColor(Qt::black), QColor(Qt::white)},
+    {QColor(Qt::green), QColor(Qt::white)},
+  };
+  view_->scene()->setItemIndexMethod(QGraphicsScene::NoIndex);
+  view_->scene()->addItem(item_);
+  item_->on_clicked = [this](int key) {
+    tree_->Erase(key);
+    Update();
   };
-  auto ShowItems = [&](auto&& self, VisualizationData *cur, qreal offset_x, qreal offset_y) -> qreal {
-    if (cur == nullptr) {
-      return 0;
-    }
-    qreal width = GetWidth(cur);
-    bool left_hack = false, right_hack = false;
-    if (cur->children.size() == 2) {
-      if (cur->children[0] != nullptr && cur->children[1] == nullptr) {
-        left_hack = true; 
+  connect(timer_, &QTimer::timeout, this, [this] {
+    AdvanceAnimation();
+  });
+}
+
+inline SceneUpdater::~SceneUpdater() {
+  if (worker_ != nullptr) {
+    worker_->wait();
+    delete worker_;
+  }
+}
+
+inline TreeItem* SceneUpdater::ReleaseItem() {
+  // The worker reads the label cache of the item.
+  if (worker_ != nullptr) {
+    worker_->wait();
+  }
+  FinishAnimation();
+  if (item_->scene() != nullptr) {
+    item_->scene()->removeItem(item_);
+  }
+  return std::exchange(item_, nullptr);
+}
+
+inline void SceneUpdater::Update() {
+  if (worker_ != nullptr) {
+    pending_ = true;
+    return;
+  }
+  FinishAnimation();
+  tree_->GetVisualizationData(*snapshot_);
+  if (const TraceRecorder *trace = tree_->GetTrace(); trace != nullptr) {
+    trace->LastPath(trace_path_);
+  } else {
+    trace_path_.clear();
+  }
+  // The worker lays out its own copy; both buffers keep their capacity.
+  std::swap(input_, *snapshot_);
+  bool animate = input_.Size() <= max_animated_nodes && animation_ms > 0;
+  worker_ = QThread::create([this, animate] {
+    Compute(animate);
+  });
+  connect(worker_, &QThread::finished, this, [this] {
+    Show();
+  });
+  worker_->start();
+}
+
+inline void SceneUpdater::Compute(bool animate) {
+  const VisualizationData<int> &data = input_;
+  TreeDrawing &drawing = next_;
+  LabelCache &label_cache = item_->label_cache;
+  qreal height = label_cache.Height() + 2 * (kTextMargin + kPadding);
+  int n = data.Size();
+  drawing.key_begin = data.key_begin;
+  drawing.child_begin = data.child_begin;
+  drawing.children = data.children;
+  drawing.keys = data.keys;
+  drawing.members = data.members;
+  drawing.key_colors.resize(data.keys.size());
+  widths_.resize(data.keys.size());
+  shape_.child_begin = data.child_begin;
+  shape_.children = data.children;
+  shape_.widths.resize(n);
+  shape_.heights.assign(n, height);
+  for (int v = 0; v < n; v++) {
+    qreal width = 0;
+    for (int k = data.key_begin[v]; k < data.key_begin[v + 1]; k++) {
+      widths_[k] = label_cache.Width(data.keys[k]) + 2 * (kTextMargin + kPadding);
+      width += widths_[k];
+      drawing.key_colors[k] = data.selected[k] ? kSelectedColor : data.colors[k];
+    }
+    shape_.widths[v] = width;
+  }
+  layout_.Compute(shape_);
+
+  drawing.key_rects.resize(data.keys.size());
+  drawing.edges.resize(n);
+  drawing.counts.resize(n);
+  drawing.min_keys.resize(n);
+  drawing.max_keys.resize(n);
+  for (int v = 0; v < n; v++) {
+    qreal x = layout_.x[v];
+    for (int k = drawing.key_begin[v]; k < drawing.key_begin[v + 1]; k++) {
+      drawing.key_rects[k] = QRectF(x, layout_.y[v], widths_[k], height);
+      x += widths_[k];
+    }
+  }
+  // Children come after their parents, so a reverse sweep sees complete subtrees.
+  for (int v = n - 1; v >= 0; v--) {
+    int first_key = drawing.key_begin[v], last_key = drawing.key_begin[v + 1] - 1;
+    int key_count = last_key - first_key + 1;
+    // Range labels are not counted.
+    drawing.counts[v] = std::count(drawing.members.begin() + first_key, drawing.members.begin() + last_key + 1, 1);
+    drawing.min_keys[v] = *std::min_element(drawing.keys.begin() + first_key, drawing.keys.begin() + last_key + 1);
+    drawing.max_keys[v] = *std::max_element(drawing.keys.begin() + first_key, drawing.keys.begin() + last_key + 1);
+    for (int k = drawing.child_begin[v]; k < drawing.child_begin[v + 1]; k++) {
+      int child = drawing.children[k];
+      if (child == -1) {
+        continue;
+      }
+      // Edges leave from the boundary between the keys around the child.
+      int slot = k - drawing.child_begin[v];
+      qreal anchor_x = slot < key_count ? drawing.key_rects[first_key + slot].left()
+                                        : drawing.key_rects[last_key].right();
+      drawing.edges[child] = QLineF(anchor_x, drawing.key_rects[first_key].bottom(),
+                                    layout_.x[child] + shape_.widths[child] / 2, layout_.y[child]);
+      drawing.counts[v] += drawing.counts[child];
+      drawing.min_keys[v] = std::min(drawing.min_keys[v], drawing.min_keys[child]);
+      drawing.max_keys[v] = std::max(drawing.max_keys[v], drawing.max_keys[child]);
+    }
+  }
+  UniteBounds(drawing.key_rects, drawing.bounds);
+  next_rect_ = QRectF(0, 0, layout_.width, layout_.height);
+
+  traced_.clear();
+  traced_.insert(trace_path_.begin(), trace_path_.end());
+  drawing.path.clear();
+  drawing.path_edges.clear();
+  for (int v = 0; v < n && !traced_.empty(); v++) {
+    if (!traced_.count(data.ids[v])) {
+      continue;
+    }
+    drawing.path.push_back(v);
+    for (int k = drawing.child_begin[v]; k < drawing.child_begin[v + 1]; k++) {
+      if (int child = drawing.children[k]; child != -1 && traced_.count(data.ids[child])) {
+        drawing.path_edges.push_back(child);
+      }
+    }
+  }
+
+  frame_count_ = 0;
+  if (animate && n > 0 && !previous_ids_.empty()) {
+    ComputeFrames();
+  }
+  previous_ids_ = data.ids;
+  previous_x_ = layout_.x;
+  previous_y_ = layout_.y;
+}
+
+inline void SceneUpdater::UniteBounds(const std::vector<QRectF> &key_rects,
+                                      std::vector<QRectF> &bounds) const {
+  const TreeDrawing &drawing = next_;
+  int n = int(drawing.key_begin.size()) - 1;
+  bounds.resize(n);
+  for (int v = n - 1; v >= 0; v--) {
+    bounds[v] = QRectF(key_rects[drawing.key_begin[v]].topLeft(),
+                       key_rects[drawing.key_begin[v + 1] - 1].bottomRight());
+    for (int k = drawing.child_begin[v]; k < drawing.child_begin[v + 1]; k++) {
+      if (int child = drawing.children[k]; child != -1) {
+        bounds[v] = bounds[v].united(bounds[child]);
       }
-      if (cur->children[0] == nullptr && cur->children[1] != nullptr) {
-        right_hack = true;
+    }
+  }
+}
+
+// Every node moves from where the node with the same id was in the previous
+// layout; new nodes come out of their parent.
+inline void SceneUpdater::ComputeFrames() {
+  const VisualizationData<int> &data = input_;
+  const TreeDrawing &drawing = next_;
+  int n = data.Size();
+  previous_index_.clear();
+  for (int i = 0; i < int(previous_ids_.size()); i++) {
+    previous_index_[previous_ids_[i]] = i;
+  }
+  parents_.assign(n, -1);
+  for (int v = 0; v < n; v++) {
+    for (int k = drawing.child_begin[v]; k < drawing.child_begin[v + 1]; k++) {
+      if (int child = drawing.children[k]; child != -1) {
+        parents_[child] = v;
       }
     }
-    qreal pure_width = cur->total_width;
-    if (left_hack || right_hack) {
-      pure_width -= kOneChildHack;
-    }
-    qreal start_x = offset_x + (pure_width - width) / 2;
-    qreal center = pure_width / 2;
-    if (left_hack) {
-      start_x += kOneChildHack;
-      center += kOneChildHack;
-    }
-    for (auto [item, text_item] : cur->items) {
-      item->setX(start_x + item->x());
-      item->setY(offset_y + item->y());
-      text_item->setX(start_x + text_item->x());
-      text_item->setY(offset_y + text_item->y());
-      scene->addItem(item);
-      scene->addItem(text_item);
-    }
-    if (right_hack) {
-      offset_x += kOneChildHack;
-    }
-    std::vector<qreal> pref(cur->items.size() + 1);
-    pref[0] = start_x;
-    for (int i = 0; i < int(cur->items.size()); i++) {
-      pref[i + 1] = pref[i] + cur->items[i].first->rect().width();
-    }
-    qreal offset_y0 = offset_y;
-    qreal h = cur->items[0].first->rect().height();
-    offset_y += h + kHeightMargin;
-    for (int i = 0; i < int(cur->children.size()); i++) {
-      auto child = cur->children[i];
-      if (child != nullptr) {
-        qreal child_center = self(self, child, offset_x, offset_y);
-        QGraphicsLineItem *line = new QGraphicsLineItem(pref[i], offset_y0 + h, offset_x + child_center, offset_y);
-        QPen pen;
-        pen.setWidth(1);
-        line->setPen(pen);
-        scene->addItem(line);
-        offset_x += child->total_width + kWidthMargin;
+  }
+  delta_x_.resize(n);
+  delta_y_.resize(n);
+  for (int v = 0; v < n; v++) {
+    if (auto iter = previous_index_.find(data.ids[v]); iter != previous_index_.end()) {
+      delta_x_[v] = previous_x_[iter->second] - layout_.x[v];
+      delta_y_[v] = previous_y_[iter->second] - layout_.y[v];
+    } else if (parents_[v] != -1) {
+      delta_x_[v] = delta_x_[parents_[v]] + layout_.x[parents_[v]] - layout_.x[v];
+      delta_y_[v] = delta_y_[parents_[v]] + layout_.y[parents_[v]] - layout_.y[v];
+    } else {
+      delta_x_[v] = delta_y_[v] = 0;
+    }
+  }
+
+  frame_count_ = std::max(1, animation_ms / kFrameInterval);
+  if (int(frames_.size()) < frame_count_) {
+    frames_.resize(frame_count_);
+  }
+  for (int f = 0; f < frame_count_; f++) {
+    Frame &frame = frames_[f];
+    qreal t = qreal(f + 1) / frame_count_;
+    // Remaining share of the way, eased in and out.
+    qreal rest = 1 - t * t * (3 - 2 * t);
+    frame.key_rects.resize(drawing.key_rects.size());
+    frame.edges.resize(n);
+    for (int v = 0; v < n; v++) {
+      qreal dx = delta_x_[v] * rest, dy = delta_y_[v] * rest;
+      for (int k = drawing.key_begin[v]; k < drawing.key_begin[v + 1]; k++) {
+        frame.key_rects[k] = drawing.key_rects[k].translated(dx, dy);
+      }
+      if (int parent = parents_[v]; parent != -1) {
+        const QLineF &edge = drawing.edges[v];
+        frame.edges[v] = QLineF(edge.p1() + QPointF(delta_x_[parent] * rest, delta_y_[parent] * rest),
+                                edge.p2() + QPointF(dx, dy));
       }
     }
-    return center;
-  };
-  PreinitItems(PreinitItems, data);
-  ShowItems(ShowItems, data, 0, 0);
-  scene->setSceneRect(scene->itemsBoundingRect());
+    UniteBounds(frame.key_rects, frame.bounds);
+    frame.rect = next_rect_.united(frame.bounds[0]);
+  }
+}
+
+inline void SceneUpdater::Show() {
+  delete worker_;
+  worker_ = nullptr;
+  TreeItem &item = *item_;
+  std::swap(static_cast<TreeDrawing &>(item), next_);
+  view_->scene()->setSceneRect(next_rect_);
+  if (frame_count_ > 0) {
+    clock_.start();
+    ShowFrame(0);
+    timer_->start(kFrameInterval);
+  } else {
+    item.Rebuild(next_rect_);
+  }
+  if (on_shown) {
+    on_shown();
+  }
+  if (pending_) {
+    pending_ = false;
+    Update();
+  }
+}
+
+inline void SceneUpdater::ShowFrame(int frame) {
+  TreeItem &item = *item_;
+  bool last = frame == frame_count_ - 1;
+  item.key_rects = frames_[frame].key_rects;
+  item.bounds = frames_[frame].bounds;
+  item.edges = frames_[frame].edges;
+  item.Rebuild(last ? next_rect_ : frames_[frame].rect, last);
+  if (last) {
+    timer_->stop();
+    frame_count_ = 0;
+  }
+}
+
+inline void SceneUpdater::AdvanceAnimation() {
+  if (frame_count_ == 0) {
+    return;
+  }
+  // Frames the timer was too late for are dropped.
+  ShowFrame(std::min<int>(frame_count_ - 1, clock_.elapsed() / kFrameInterval));
+}
+
+inline void SceneUpdater::FinishAnimation() {
+  if (frame_count_ > 0) {
+    ShowFrame(frame_count_ - 1);
+  }
 }
 
 #endif // VISUALIZATION_H
@@ -2,51 +2,197 @@
 #define VISUALIZATION_H
 
 #include <QWidget>
-#include <QGraphicsRectItem>
+#include <QGraphicsItem>
 #include <QGraphicsScene>
+#include <QGraphicsView>
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
+#include <QLineF>
+#include <QFont>
+#include <QFontMetricsF>
+#include <QStaticText>
 #include <QGraphicsSceneMouseEvent>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QThread>
 #include <iostream>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <functional>
+#include "VisualizableTree.h"
+#include "TreeLayout.h"
+#include "SpatialGrid.h"
 
-struct VisualizationData;
+// Sizes and pre-shaped QStaticText of key labels, formatted on first use.
+// Widths are arithmetic when the digits of the font have equal advances,
+// which is the case for nearly every UI font; otherwise measured once each.
+class LabelCache {
+ public:
+  explicit LabelCache(const QFont &font);
+
+  const QFont& Font() const;
+
+  qreal Width(int key);
+
+  qreal Height() const;
 
-template <typename T>
-struct VisualizableTree {
-  virtual void Insert(T value) = 0;
-  virtual void Erase(T value) = 0;
-  virtual bool Find(T value) = 0;
+  const QStaticText& Text(int key);
 
-  virtual VisualizationData* GetVisualizationData() = 0;
+ private:
+  // Bounds both maps; labels on screen at once are far fewer.
+  static constexpr size_t kMaxEntries = 1 << 14;
 
-  virtual ~VisualizableTree() = default;
+  QFont font_;
+  QFontMetricsF metrics_;
+  // Advance of every digit, or -1 if they differ.
+  qreal digit_width_, minus_width_;
+  std::unordered_map<int, qreal> widths_;
+  std::unordered_map<int, QStaticText> texts_;
 };
 
-class NodeItem : public QObject, public QGraphicsRectItem {
-  Q_OBJECT
+// Laid out tree in flat arrays. Every node comes after its parent and node 0
+// is the root. The children of node v are children[child_begin[v]] ..
+// children[child_begin[v + 1] - 1], -1 for an empty slot, and its keys are
+// the ones from key_begin[v] to key_begin[v + 1] - 1.
+struct TreeDrawing {
+  std::vector<int> child_begin, children, key_begin;
+  // Per node: bounds of the subtree, the edge from the parent, key count and
+  // key range of the subtree.
+  std::vector<QRectF> bounds;
+  std::vector<QLineF> edges;
+  std::vector<int> counts, min_keys, max_keys;
+  // Per key: its rect, value, an index into the palette and whether it is a
+  // member of the tree rather than a range label.
+  std::vector<QRectF> key_rects;
+  std::vector<int> keys;
+  std::vector<int> key_colors;
+  std::vector<uint8_t> members;
+  // Nodes visited by the last traced operation, and the ones of them whose
+  // edge from the parent is part of that path.
+  std::vector<int> path, path_edges;
+};
+
+// Draws a whole laid out tree in one batched pass. Painting walks the nodes
+// from the root, skipping subtrees outside the exposed rect and collapsing
+// the ones smaller than summary_pixels on screen into a single glyph with
+// their key count and range. Clicks are resolved through a spatial index over
+// the key rects.
+class TreeItem : public QGraphicsItem, public TreeDrawing {
  public:
-  explicit NodeItem(QObject *parent = nullptr) : QObject(parent) {}
- 
-  VisualizableTree<int> *ds;
-  QWidget *widget;
-  QGraphicsScene *scene;
+  TreeItem();
+
+  qreal summary_pixels = 40;
+
+  // Called with the key under a left click; range labels are not clicked.
+  std::function<void(int)> on_clicked;
 
-  int value;
+  LabelCache label_cache;
 
- signals:
-  void clicked(NodeItem *item);
+  std::vector<std::pair<QColor, QColor>> palette;
+
+  // Call after the arrays were refilled. Intermediate frames of an animation
+  // pass clickable = false and skip building the click index.
+  void Rebuild(QRectF rect, bool clickable = true);
+
+  QRectF boundingRect() const override;
+
+  void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) override;
 
  protected:
-  void mousePressEvent(QGraphicsSceneMouseEvent* event) override {
-    emit clicked(this);
-  }
+  void mousePressEvent(QGraphicsSceneMouseEvent *event) override;
+
+ private:
+  QRectF rect_;
+  SpatialGrid grid_;
+  qreal last_lod_ = 1;
+
+  // Scratch buffers of paint(), kept to avoid allocations.
+  std::vector<int> stack_, visible_keys_, summaries_;
+  std::vector<QLineF> visible_edges_;
+  std::vector<QRectF> batch_;
+
+  void DrawSummary(QPainter *painter, int node, qreal lod);
 };
 
-struct VisualizationData { 
-  std::vector<std::pair<QColor, QColor>> colors;
-  std::vector<VisualizationData*> children;
-  std::vector<std::string> keys;
+// Lays out snapshots of a tree and shows them through a TreeItem. The
+// snapshot buffer belongs to the caller and is reused for every update.
+//
+// Layouts are computed on a worker thread. Trees of at most
+// max_animated_nodes nodes move from the previous layout to the new one over
+// animation_ms; the worker also precomputes every frame, so the GUI thread
+// only copies a frame into the item on each timer tick, dropping frames when
+// it falls behind.
+class SceneUpdater : public QObject {
+ public:
+  SceneUpdater(VisualizableTree<int> *tree, QGraphicsView *view, VisualizationData<int> *snapshot);
+
+  ~SceneUpdater();
+
+  int max_animated_nodes = 2000;
+  int animation_ms = 300;
+
+  // Called whenever a new layout has been taken over by the item.
+  std::function<void()> on_shown;
+
+  // Takes a new snapshot of the tree and shows it once it is laid out.
+  void Update();
+
+  // Removes the item from the scene and hands it to the caller, e.g. to be
+  // freed in the background together with the tree.
+  TreeItem* ReleaseItem();
+
+ private:
+  struct Frame {
+    std::vector<QRectF> key_rects, bounds;
+    std::vector<QLineF> edges;
+    QRectF rect;
+  };
+
+  VisualizableTree<int> *tree_;
+  QGraphicsView *view_;
+  VisualizationData<int> *snapshot_;
+  TreeItem *item_;
+  QTimer *timer_;
+  QElapsedTimer clock_;
+  QThread *worker_ = nullptr;
+  // Set when Update is called while the worker is busy.
+  bool pending_ = false;
+
+  // Owned by the worker while it runs.
+  VisualizationData<int> input_;
+  TreeDrawing next_;
+  QRectF next_rect_;
+  std::vector<Frame> frames_;
+  int frame_count_ = 0;
+  std::vector<qreal> widths_;
+  TreeShape shape_;
+  TreeLayout layout_;
+  // Node positions of the previous layout, the start of the next animation.
+  std::vector<uint64_t> previous_ids_;
+  std::vector<qreal> previous_x_, previous_y_;
+  std::unordered_map<uint64_t, int> previous_index_;
+  std::vector<int> parents_;
+  std::vector<qreal> delta_x_, delta_y_;
+  // Ids of the nodes on the traced path, taken with the snapshot.
+  std::vector<uint64_t> trace_path_;
+  std::unordered_set<uint64_t> traced_;
+
+  // Runs on the worker.
+  void Compute(bool animate);
+
+  void UniteBounds(const std::vector<QRectF> &key_rects, std::vector<QRectF> &bounds) const;
+
+  void ComputeFrames();
+
+  // GUI thread: takes over the result of the worker.
+  void Show();
+
+  void ShowFrame(int frame);
+
+  void AdvanceAnimation();
 
-  std::vector<std::pair<NodeItem*, QGraphicsTextItem*>> items;
-  qreal total_width;
+  void FinishAnimation();
 };
 
 #endif // VISUALIZATION_H
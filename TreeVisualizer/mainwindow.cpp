@@ -5,16 +5,33 @@
 #include "impl/SplayTree.cpp"
 #include "impl/BTree.cpp"
 #include "impl/Treap.cpp"
+#include "impl/ScapegoatTree.cpp"
+#include "impl/VebTree.cpp"
+#include "impl/ArtTree.cpp"
+#include "impl/PagedBTree.cpp"
+#include "impl/TreeEngine.cpp"
+#include "impl/TreeLayout.cpp"
+#include "impl/SpatialGrid.cpp"
 #include "impl/Visualization.cpp"
+#include "impl/KeyPermutation.cpp"
+#include "impl/OperationTrace.cpp"
+#include "impl/Reclaimer.cpp"
+#include "impl/Comparison.cpp"
+#include "impl/FactorTuner.cpp"
 #include <iostream>
 #include <QShortcut>
 #include <QGraphicsRectItem>
 #include <QKeySequence>
 #include <QCursor>
+#include <QTimer>
+#include <QFileDialog>
+#include <QMessageBox>
+#include <fstream>
 #include <string>
 #include <limits>
-#include <random>
-#include <chrono>
+#include <algorithm>
+#include <utility>
+#include <filesystem>
 
 Widget::Widget(QWidget *parent) : QWidget(parent), ui(new Ui::Widget) {
   ui->setupUi(this);
@@ -29,6 +46,10 @@ Widget::Widget(QWidget *parent) : QWidget(parent), ui(new Ui::Widget) {
   ui->treeComboBox->insertItem(3, QString("Splay Tree"));
   ui->treeComboBox->insertItem(4, QString("B-Tree"));
   ui->treeComboBox->insertItem(5, QString("Treap"));
+  ui->treeComboBox->insertItem(6, QString("Scapegoat Tree"));
+  ui->treeComboBox->insertItem(7, QString("vEB Tree"));
+  ui->treeComboBox->insertItem(8, QString("ART"));
+  ui->treeComboBox->insertItem(9, QString("Paged B-Tree"));
 
   QShortcut *zoomInShortcut = new QShortcut(QKeySequence(Qt::CTRL | Qt::Key_Equal), this);
   QObject::connect(zoomInShortcut, &QShortcut::activated, this, &Widget::ZoomIn);
@@ -48,69 +69,195 @@ int Widget::GetNodeInput(QLineEdit *edit) {
 
 void Widget::on_insertButton_clicked() {
   if (int inp = GetNodeInput(ui->valueEdit); inp != -1) {
-    if (tree != nullptr) {
+    if (tree != nullptr && fill_thread == nullptr) {
       tree->Insert(inp);
       ui->gView->centerOn(0, 0);
-      Visualize(tree, this, ui->gView->scene(), tree->GetVisualizationData());
+      updater->Update();
     }
   }
 }
 
 void Widget::on_eraseButton_clicked() {
   if (int inp = GetNodeInput(ui->valueEdit); inp != -1) {
-    if (tree != nullptr) {
+    if (tree != nullptr && fill_thread == nullptr) {
       tree->Erase(inp);
-      Visualize(tree, this, ui->gView->scene(), tree->GetVisualizationData());
+      updater->Update();
     }
   }
 }
 
 void Widget::on_findButton_clicked() {
   if (int inp = GetNodeInput(ui->valueEdit); inp != -1) {
-    if (tree != nullptr) {
+    if (tree != nullptr && fill_thread == nullptr) {
       tree->Find(inp);
-      Visualize(tree, this, ui->gView->scene(), tree->GetVisualizationData());
+      updater->Update();
     }
   }
 }
 
 void Widget::on_randomButton_clicked() {
-  static std::mt19937 rng(std::chrono::steady_clock::now().time_since_epoch().count());
   if (int inp = GetNodeInput(ui->valueEdit); inp != -1) {
-    if (tree != nullptr) {
-      int iter = 0;
-      double start_time = 1.0 * clock() / CLOCKS_PER_SEC;
-      for (int i = 0; i < inp && 1.0 * clock() / CLOCKS_PER_SEC <= start_time + 0.1; i++) {
-        int value = rng() % int(1e9) + 1;
-        if (tree->Find(value)) {
-          --i;
-          continue;
-        }
-        tree->Insert(value);
+    if (tree != nullptr && fill_thread == nullptr) {
+      int count = std::min<int64_t>(inp, KeyPermutation::kRange - random_index);
+      if (count <= 0) {
+        return;
       }
-      ui->gView->centerOn(0, 0);
-      Visualize(tree, this, ui->gView->scene(), tree->GetVisualizationData());
+      uint32_t first = random_index;
+      random_index += count;
+      fill_done = 0;
+      fill_cancel = false;
+      fill_thread = QThread::create([this, target = tree, keys = random_keys, first, count] {
+        constexpr int kProgressStep = 1 << 12;
+        for (int i = 0; i < count; i++) {
+          target->Insert(keys(first + i));
+          if ((i + 1) % kProgressStep == 0) {
+            fill_done.store(i + 1, std::memory_order_relaxed);
+            if (fill_cancel.load(std::memory_order_relaxed)) {
+              return;
+            }
+          }
+        }
+        fill_done = count;
+      });
+      // The dialog is window-modal and shown at once, and the slots that touch
+      // the tree return early until the worker has finished; clicks on the
+      // view, which erase keys, are off meanwhile.
+      fill_progress = new QProgressDialog("Inserting random keys...", "Cancel", 0, count, this);
+      fill_progress->setWindowModality(Qt::WindowModal);
+      fill_progress->setMinimumDuration(0);
+      ui->gView->setInteractive(false);
+      connect(fill_progress, &QProgressDialog::canceled, this, [this] {
+        fill_cancel = true;
+      });
+      QTimer *timer = new QTimer(fill_progress);
+      connect(timer, &QTimer::timeout, this, [this] {
+        if (fill_progress != nullptr) {
+          fill_progress->setValue(fill_done);
+        }
+      });
+      timer->start(50);
+      connect(fill_thread, &QThread::finished, this, &Widget::FinishRandomFill);
+      fill_thread->start();
     }
   }
 }
 
+void Widget::on_exportTraceButton_clicked() {
+  if (tree == nullptr || fill_thread != nullptr || tree->GetTrace() == nullptr) {
+    return;
+  }
+  QString path = QFileDialog::getSaveFileName(this, "Export trace", "trace.csv", "CSV files (*.csv)");
+  if (path.isEmpty()) {
+    return;
+  }
+  std::ofstream out(path.toStdString());
+  tree->GetTrace()->Export(out);
+}
+
+void Widget::on_compareButton_clicked() {
+  if (comparison == nullptr) {
+    comparison = new ComparisonDialog(factor, &reclaimer, this);
+    comparison->setAttribute(Qt::WA_DeleteOnClose);
+    connect(comparison, &QObject::destroyed, this, [this] {
+      comparison = nullptr;
+    });
+  }
+  comparison->show();
+  comparison->raise();
+}
+
+void Widget::on_autoTuneButton_clicked() {
+  if (tree == nullptr || tune_thread != nullptr || fill_thread != nullptr) {
+    return;
+  }
+  // Not the shared snapshot, the scene updater may be reading it.
+  VisualizationData<int> data;
+  tree->GetVisualizationData(data);
+  std::vector<int> keys = data.MemberKeys();
+  if (keys.empty()) {
+    ui->tuningLabel->setText("Insert keys to tune on");
+    return;
+  }
+  // Calibrate for the read/write mix of the recent operations.
+  size_t finds = 0, updates = 0;
+  if (const TraceRecorder *trace = tree->GetTrace(); trace != nullptr) {
+    for (size_t i = 0; i < trace->Size(); i++) {
+      TraceEvent::Kind kind = (*trace)[i].kind;
+      finds += kind == TraceEvent::kFind;
+      updates += kind == TraceEvent::kInsert || kind == TraceEvent::kErase;
+    }
+  }
+  tuner.find_share = finds + updates > 0 ? double(finds) / (finds + updates) : 0.5;
+  ui->autoTuneButton->setEnabled(false);
+  ui->tuningLabel->setText("Tuning...");
+  tune_thread = QThread::create([this, keys = std::move(keys)] {
+    tuned_factor = tuner.Tune(keys);
+  });
+  connect(tune_thread, &QThread::finished, this, &Widget::FinishTuning);
+  tune_thread->start();
+}
+
+void Widget::FinishTuning() {
+  tune_thread->deleteLater();
+  tune_thread = nullptr;
+  ui->autoTuneButton->setEnabled(true);
+  if (tuned_factor == 0) {
+    return;
+  }
+  QString details;
+  for (const FactorTuner::Timing &timing : tuner.Timings()) {
+    details += QString("factor %1: %2 ns/op\n").arg(timing.factor).arg(timing.ns_per_op, 0, 'f', 1);
+  }
+  auto best = std::find_if(tuner.Timings().begin(), tuner.Timings().end(), [this](const auto &timing) {
+    return timing.factor == tuned_factor;
+  });
+  ui->tuningLabel->setText(QString("Best factor %1, %2 ns/op").arg(tuned_factor).arg(best->ns_per_op, 0, 'f', 1));
+  ui->tuningLabel->setToolTip(details);
+  factor = tuned_factor;
+  ui->childFactorEdit->setText(QString::number(factor));
+  if (index == 4) {
+    // A random fill may have started while tuning; the tree is rebuilt once
+    // it is over.
+    if (fill_thread != nullptr) {
+      rebuild_after_fill = true;
+    } else {
+      MakeTree();
+    }
+  }
+}
+
+void Widget::FinishRandomFill() {
+  fill_thread->deleteLater();
+  fill_thread = nullptr;
+  fill_progress->hide();
+  fill_progress->deleteLater();
+  fill_progress = nullptr;
+  ui->gView->setInteractive(true);
+  if (std::exchange(rebuild_after_fill, false)) {
+    MakeTree();
+    return;
+  }
+  ui->gView->centerOn(0, 0);
+  updater->Update();
+}
+
 void Widget::MakeTree() {
+  // The fill worker is inserting into the tree.
+  if (fill_thread != nullptr) {
+    return;
+  }
   std::vector<int> init_keys;
   if (tree != nullptr) {
-    VisualizationData *data = tree->GetVisualizationData();
-    auto DFS = [&](auto&& self, VisualizationData *root) {
-      if (root == nullptr) {
-        return;
-      }
-      for (auto key : root->keys) {
-        init_keys.push_back(std::stoi(key));
-      }
-      for (auto child : root->children) {
-        self(self, child);
-      }
-    };
-    DFS(DFS, data);
+    tree->GetVisualizationData(snapshot);
+    init_keys = snapshot.MemberKeys();
+  }
+  // Large trees take seconds to free, so they go to the reclaimer along
+  // with their drawing.
+  if (updater != nullptr) {
+    reclaimer.Discard(updater->ReleaseItem());
   }
+  delete updater;
+  updater = nullptr;
   if (ui->gView->scene()) {
     ui->gView->scene()->clear();
   }
@@ -120,29 +267,51 @@ void Widget::MakeTree() {
   ui->gView->setAlignment(Qt::AlignCenter);
   ui->gView->setScene(new QGraphicsScene(ui->gView));
   ui->gView->setViewportUpdateMode(QGraphicsView::MinimalViewportUpdate);
-  delete tree;
+  reclaimer.Discard(tree);
   if (index == 1) {
-    tree = new AVLTree<int>();
+    tree = new TreeAdapter<TracedEngine<AVLTree, int>>();
   } else if (index == 2) {
-    tree = new RBTree<int>();
+    tree = new TreeAdapter<TracedEngine<RBTree, int>>();
   } else if (index == 3) {
-    tree = new SplayTree<int>(); 
+    tree = new TreeAdapter<TracedEngine<SplayTree, int>>(); 
   } else if (index == 4) {
-    tree = new BTree<int>(factor);
+    tree = new TreeAdapter<TracedEngine<BTree, int>>(factor);
   } else if (index == 5) {
-    tree = new Treap<int>();
+    tree = new TreeAdapter<TracedEngine<Treap, int>>();
+  } else if (index == 6) {
+    tree = new TreeAdapter<TracedEngine<ScapegoatTree, int>>();
+  } else if (index == 7) {
+    tree = new TreeAdapter<TracedEngine<VebTree, int>>();
+  } else if (index == 8) {
+    tree = new TreeAdapter<TracedEngine<ArtTree, int>>();
+  } else if (index == 9) {
+    std::error_code error;
+    auto path = std::filesystem::temp_directory_path(error) / "TreeVisualizer.pages";
+    auto *paged = error ? nullptr : new TreeAdapter<TracedEngine<PagedBTree, int>>(path.string(), factor);
+    if (paged != nullptr && paged->engine.GetPool().IsOpen() && !paged->engine.GetPool().Failed()) {
+      tree = paged;
+    } else {
+      delete paged;
+      tree = nullptr;
+      QMessageBox::warning(this, "Paged B-Tree", QString("Cannot create the page file %1")
+                                                   .arg(QString::fromStdString(path.string())));
+    }
   } else {
     tree = nullptr;
   }
   if (tree != nullptr) {
+    updater = new SceneUpdater(tree, ui->gView, &snapshot);
     for (int key : init_keys) {
       tree->Insert(key);
     }
-    Visualize(tree, this, ui->gView->scene(), tree->GetVisualizationData());
+    updater->Update();
   }
 }
 
 void Widget::on_submitButton_clicked() {
+  if (fill_thread != nullptr) {
+    return;
+  }
   if (int res = GetNodeInput(ui->childFactorEdit); res >= 2) {
     factor = res;
     MakeTree();
@@ -150,6 +319,10 @@ void Widget::on_submitButton_clicked() {
 }
 
 void Widget::on_treeComboBox_currentIndexChanged(int ind) {
+  if (fill_thread != nullptr) {
+    ui->treeComboBox->setCurrentIndex(index);
+    return;
+  }
   index = ind;
   MakeTree();
 }
@@ -169,5 +342,15 @@ void Widget::ZoomOut() {
 }
 
 Widget::~Widget() {
+  if (fill_thread != nullptr) {
+    fill_cancel = true;
+    fill_thread->wait();
+  }
+  if (tune_thread != nullptr) {
+    tune_thread->wait();
+  }
+  // Both wait for their threads and use the reclaimer.
+  delete comparison;
+  delete updater;
   delete ui;
 }
@@ -4,7 +4,14 @@
 #include <QWidget>
 #include <QWheelEvent>
 #include <QLineEdit>
+#include <QThread>
+#include <QProgressDialog>
+#include <atomic>
 #include "impl/Visualization.h"
+#include "impl/KeyPermutation.h"
+#include "impl/Reclaimer.h"
+#include "impl/Comparison.h"
+#include "impl/FactorTuner.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class Widget; }
@@ -18,6 +25,9 @@ class Widget : public QWidget {
   ~Widget();
 
   VisualizableTree<int> *tree = nullptr;
+  SceneUpdater *updater = nullptr;
+  // Reused by every snapshot of the tree.
+  VisualizationData<int> snapshot;
   int index = 0, factor = 2;
 
  private slots:
@@ -27,10 +37,31 @@ class Widget : public QWidget {
   void on_findButton_clicked();
   void on_treeComboBox_currentIndexChanged(int index);
   void on_randomButton_clicked();
+  void on_exportTraceButton_clicked();
+  void on_compareButton_clicked();
+  void on_autoTuneButton_clicked();
 
  private:
   Ui::Widget *ui;
 
+  Reclaimer reclaimer;
+  ComparisonDialog *comparison = nullptr;
+
+  KeyPermutation random_keys;
+  uint32_t random_index = 0;
+
+  QThread *fill_thread = nullptr;
+  QProgressDialog *fill_progress = nullptr;
+  std::atomic<int> fill_done = 0;
+  std::atomic<bool> fill_cancel = false;
+
+  // Calibrates on a copy of the keys, so the tree stays usable meanwhile.
+  FactorTuner tuner;
+  QThread *tune_thread = nullptr;
+  int tuned_factor = 0;
+  // Set when tuning ends during a random fill.
+  bool rebuild_after_fill = false;
+
   int GetNodeInput(QLineEdit *edit);
 
   void ZoomIn();
@@ -40,6 +71,10 @@ class Widget : public QWidget {
   void ZoomView(qreal factor);
 
   void MakeTree();
+
+  void FinishRandomFill();
+
+  void FinishTuning();
 };
 
 #endif // MAINWINDOW_H